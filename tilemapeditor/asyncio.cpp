@@ -0,0 +1,481 @@
+#include "asyncio.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <iomanip>
+#include <initializer_list>
+#include <iostream>
+#include <thread>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// io_uring is driven through its system calls, so the kernel header is all the backend needs
+#if defined(__linux__) && !defined(TILEMAP_NO_IO_URING) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#define TILEMAP_IO_URING
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#endif
+#endif
+
+#ifdef TILEMAP_IO_URING
+struct AsyncIO::Ring {
+    struct Pending {    // an operation the kernel has, its submission's user data points here
+        IoOperation operation;
+        size_t done;    // bytes moved so far, a short transfer is submitted again for the rest
+        IoTicket* ticket;
+        std::chrono::steady_clock::time_point submitted;
+    };
+    AsyncIO* io = nullptr;  // records the operations that fail before the kernel took them
+    int fd = -1;
+    void* sqRing = MAP_FAILED;
+    size_t sqRingSize = 0;
+    void* cqRing = MAP_FAILED;
+    size_t cqRingSize = 0;
+    io_uring_sqe* sqes = static_cast<io_uring_sqe*>(MAP_FAILED);
+    size_t sqesSize = 0;
+    unsigned* sqHead = nullptr;
+    unsigned* sqTail = nullptr;
+    unsigned* sqArray = nullptr;
+    unsigned sqMask = 0;
+    unsigned* cqHead = nullptr;
+    unsigned* cqTail = nullptr;
+    unsigned cqMask = 0;
+    io_uring_cqe* cqes = nullptr;
+    unsigned entries = 0;
+    std::mutex mutex;   // guards the submission queue, queued and isStopping
+    std::condition_variable slotFreed;
+    size_t queued = 0;  // operations the kernel hasn't completed, never more than entries so the completion queue can't overflow
+    bool isStopping = false;
+    std::thread completions;
+
+    ~Ring() {
+        if (sqes != MAP_FAILED) munmap(sqes, sqesSize);
+        if (cqRing != MAP_FAILED && cqRing != sqRing) munmap(cqRing, cqRingSize);
+        if (sqRing != MAP_FAILED) munmap(sqRing, sqRingSize);
+        if (fd >= 0) close(fd);
+    }
+
+    void Push(Pending* pending) {
+        // the caller holds mutex and made sure a slot is free
+        unsigned tail = *sqTail;
+        unsigned index = tail & sqMask;
+        io_uring_sqe& sqe = sqes[index];
+        std::memset(&sqe, 0, sizeof(sqe));
+        if (pending) {
+            const IoOperation& operation = pending->operation;
+            sqe.opcode = operation.isWrite ? IORING_OP_WRITE : IORING_OP_READ;
+            sqe.fd = static_cast<int>(operation.file);
+            sqe.off = operation.offset + pending->done;
+            sqe.addr = reinterpret_cast<std::uint64_t>(operation.data + pending->done);
+            sqe.len = static_cast<unsigned>(operation.size - pending->done);
+            ++queued;
+        }
+        else {
+            sqe.opcode = IORING_OP_NOP;     // wakes the completion thread when the ring stops
+        }
+        sqe.user_data = reinterpret_cast<std::uint64_t>(pending);
+        sqArray[index] = index;
+        __atomic_store_n(sqTail, tail + 1, __ATOMIC_RELEASE);
+    }
+
+    long Enter(unsigned toSubmit, unsigned minComplete, unsigned flags) {
+        // returns how many submissions the kernel consumed, or -1
+        for (;;) {
+            long consumed = syscall(__NR_io_uring_enter, fd, toSubmit, minComplete, flags, nullptr, 0);
+            if (consumed >= 0) return consumed;
+            if (errno == EAGAIN || errno == EBUSY) { std::this_thread::yield(); }
+            else if (errno != EINTR) return -1;
+        }
+    }
+
+    bool Flush() {
+        // the caller holds mutex, hands every pushed submission to the kernel, which may consume fewer than it was offered
+        unsigned tail = *sqTail;
+        for (;;) {
+            unsigned head = __atomic_load_n(sqHead, __ATOMIC_ACQUIRE);
+            if (head == tail) return true;
+            if (Enter(tail - head, 0, 0) <= 0) return false;
+        }
+    }
+
+    void FailRefused(const std::vector<Pending*>& pushed) {
+        // the caller holds mutex after Flush failed, the submissions the kernel didn't consume are the last ones pushed and fail
+        // instead of never completing, the ones it consumed before that complete through the completion thread as usual
+        unsigned head = __atomic_load_n(sqHead, __ATOMIC_ACQUIRE);
+        size_t refused = std::min<size_t>(*sqTail - head, pushed.size());
+        __atomic_store_n(sqTail, head, __ATOMIC_RELEASE);
+        for (size_t i = pushed.size() - refused; i < pushed.size(); ++i) {
+            Pending* pending = pushed[i];
+            --queued;
+            io->RecordCompletion(pending->operation, pending->submitted, false);
+            pending->ticket->Complete(false);
+            delete pending;
+        }
+    }
+
+    bool IsSupported(std::initializer_list<unsigned> opcodes) {
+        // kernels before 5.6 create rings without the plain read and write opcodes, and without the probe that reports them
+        const unsigned probedCount = 256;
+        std::vector<char> storage(sizeof(io_uring_probe) + probedCount * sizeof(io_uring_probe_op), 0);
+        io_uring_probe* probe = reinterpret_cast<io_uring_probe*>(storage.data());
+        if (syscall(__NR_io_uring_register, fd, IORING_REGISTER_PROBE, probe, probedCount) < 0) return false;
+        for (unsigned opcode : opcodes) {
+            if (opcode > probe->last_op || !(probe->ops[opcode].flags & IO_URING_OP_SUPPORTED)) return false;
+        }
+        return true;
+    }
+};
+#else
+struct AsyncIO::Ring {};
+#endif
+
+const AsyncIO::FileHandle AsyncIO::InvalidFile;
+const size_t AsyncIO::BlockSize;
+
+void IoTicket::Complete(bool isDone) {
+    std::function<void(bool)> callback;
+    bool isSucceeded = false;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!isDone) isFailed = true;
+        if (--pending != 0) return;
+        finished.notify_all();
+        callback.swap(onDone);
+        isSucceeded = !isFailed;
+    }
+    // the ticket may be gone by the time the main thread runs the callback, so it only gets the result
+    if (callback) { ThreadPool::GetShared().PostToMainThread([callback, isSucceeded] { callback(isSucceeded); }); }
+}
+
+bool IoTicket::Wait() {
+    tasks.Wait();   // on the pool backend, operations nobody picked up yet run right here
+    std::unique_lock<std::mutex> lock(mutex);
+    finished.wait(lock, [this] { return pending == 0; });
+    return !isFailed;
+}
+
+bool IoTicket::IsDone() {
+    std::lock_guard<std::mutex> lock(mutex);
+    return pending == 0;
+}
+
+AsyncIO::AsyncIO() {
+    // older kernels and sandboxes that refuse io_uring keep the thread pool backend
+    StartRing();
+}
+
+AsyncIO::~AsyncIO() {
+    StopRing();
+}
+
+AsyncIO& AsyncIO::GetShared() {
+    static AsyncIO io;
+    return io;
+}
+
+bool AsyncIO::StartRing() {
+#ifdef TILEMAP_IO_URING
+    std::unique_ptr<Ring> created(new Ring);
+    io_uring_params params;
+    std::memset(&params, 0, sizeof(params));
+    created->fd = static_cast<int>(syscall(__NR_io_uring_setup, 64, &params));
+    if (created->fd < 0) return false;
+    created->sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    created->cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    bool isSingleMap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+    if (isSingleMap) { created->sqRingSize = created->cqRingSize = std::max(created->sqRingSize, created->cqRingSize); }
+    created->sqRing = mmap(nullptr, created->sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, created->fd, IORING_OFF_SQ_RING);
+    if (created->sqRing == MAP_FAILED) return false;
+    created->cqRing = isSingleMap ? created->sqRing : mmap(nullptr, created->cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, created->fd, IORING_OFF_CQ_RING);
+    if (created->cqRing == MAP_FAILED) return false;
+    created->sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+    created->sqes = static_cast<io_uring_sqe*>(mmap(nullptr, created->sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, created->fd, IORING_OFF_SQES));
+    if (created->sqes == MAP_FAILED) return false;
+    char* sq = static_cast<char*>(created->sqRing);
+    created->sqHead = reinterpret_cast<unsigned*>(sq + params.sq_off.head);
+    created->sqTail = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+    created->sqArray = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+    created->sqMask = *reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+    char* cq = static_cast<char*>(created->cqRing);
+    created->cqHead = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+    created->cqTail = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+    created->cqMask = *reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+    created->cqes = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+    created->entries = params.sq_entries;
+    created->io = this;
+    if (!created->IsSupported({ IORING_OP_READ, IORING_OP_WRITE, IORING_OP_NOP })) return false;
+    ring = std::move(created);
+    ring->completions = std::thread(&AsyncIO::RunRingCompletions, this);
+    return true;
+#else
+    return false;
+#endif
+}
+
+void AsyncIO::StopRing() {
+#ifdef TILEMAP_IO_URING
+    if (!ring) return;
+    {
+        // operations still in flight complete first, then a no-op wakes the completion thread for the last time
+        std::unique_lock<std::mutex> lock(ring->mutex);
+        ring->slotFreed.wait(lock, [this] { return ring->queued == 0; });
+        ring->isStopping = true;
+        ring->Push(nullptr);
+        ring->Flush();
+    }
+    ring->completions.join();
+    ring.reset();
+#endif
+}
+
+void AsyncIO::SubmitToRing(std::vector<IoOperation>& operations, const std::shared_ptr<IoTicket>& ticket) {
+#ifdef TILEMAP_IO_URING
+    std::chrono::steady_clock::time_point submitted = std::chrono::steady_clock::now();
+    std::unique_lock<std::mutex> lock(ring->mutex);
+    // the whole batch goes to the kernel with one system call, unless it is bigger than the ring
+    std::vector<Ring::Pending*> batch;
+    for (size_t i = 0; i <= operations.size(); ++i) {
+        if (i == operations.size() || ring->queued == ring->entries) {
+            if (!ring->Flush()) {
+                std::cerr << "Failed to submit file operations to io_uring\n";
+                ring->FailRefused(batch);
+            }
+            batch.clear();
+            if (i == operations.size()) break;
+            ring->slotFreed.wait(lock, [this] { return ring->queued < ring->entries; });
+        }
+        Ring::Pending* pending = new Ring::Pending{ std::move(operations[i]), 0, ticket.get(), submitted };
+        ring->Push(pending);
+        batch.push_back(pending);
+    }
+#endif
+}
+
+void AsyncIO::RunRingCompletions() {
+#ifdef TILEMAP_IO_URING
+    for (;;) {
+        if (ring->Enter(0, 1, IORING_ENTER_GETEVENTS) < 0) {
+            std::cerr << "Failed to wait for io_uring completions\n";
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        std::lock_guard<std::mutex> lock(ring->mutex);
+        unsigned head = *ring->cqHead;
+        unsigned tail = __atomic_load_n(ring->cqTail, __ATOMIC_ACQUIRE);
+        std::vector<Ring::Pending*> resubmitted;
+        for (; head != tail; ++head) {
+            const io_uring_cqe& cqe = ring->cqes[head & ring->cqMask];
+            Ring::Pending* pending = reinterpret_cast<Ring::Pending*>(cqe.user_data);
+            if (!pending) continue;     // the no-op of StopRing
+            --ring->queued;
+            int result = cqe.res;
+            size_t remaining = pending->operation.size - pending->done;
+            if (result == -EINTR || result == -EAGAIN || (result > 0 && static_cast<size_t>(result) < remaining)) {
+                // a short transfer goes back to the kernel for the rest
+                if (result > 0) pending->done += result;
+                ring->Push(pending);
+                resubmitted.push_back(pending);
+                continue;
+            }
+            bool isDone = result >= 0 && static_cast<size_t>(result) == remaining;
+            RecordCompletion(pending->operation, pending->submitted, isDone);
+            pending->ticket->Complete(isDone);
+            delete pending;
+        }
+        __atomic_store_n(ring->cqHead, head, __ATOMIC_RELEASE);
+        if (!resubmitted.empty() && !ring->Flush()) {
+            std::cerr << "Failed to resubmit a short io_uring transfer\n";
+            ring->FailRefused(resubmitted);
+        }
+        ring->slotFreed.notify_all();
+        if (ring->isStopping && ring->queued == 0) return;
+    }
+#endif
+}
+
+std::shared_ptr<IoTicket> AsyncIO::Submit(std::vector<IoOperation> operations, std::function<void(bool)> onDone) {
+    std::shared_ptr<IoTicket> ticket = std::make_shared<IoTicket>();
+    if (operations.empty()) {
+        if (onDone) { ThreadPool::GetShared().PostToMainThread([onDone] { onDone(true); }); }
+        return ticket;
+    }
+    ticket->pending = operations.size();
+    ticket->onDone = std::move(onDone);
+    RecordSubmit(operations.size());
+    if (ring) {
+        SubmitToRing(operations, ticket);
+        return ticket;
+    }
+    // the ticket outlives its tasks, its task group waits for them
+    std::chrono::steady_clock::time_point submitted = std::chrono::steady_clock::now();
+    IoTicket* target = ticket.get();
+    for (IoOperation& operation : operations) {
+        target->tasks.Submit("file io", [this, operation, submitted, target] {
+            bool isDone = Transfer(operation);
+            RecordCompletion(operation, submitted, isDone);
+            target->Complete(isDone);
+        });
+    }
+    return ticket;
+}
+
+bool AsyncIO::Transfer(const IoOperation& operation) {
+    size_t done = 0;
+    while (done < operation.size) {
+#ifdef _WIN32
+        // a synchronous handle still takes the position from the OVERLAPPED, so several tasks can write one file at once
+        std::uint64_t offset = operation.offset + done;
+        OVERLAPPED overlapped = {};
+        overlapped.Offset = static_cast<DWORD>(offset);
+        overlapped.OffsetHigh = static_cast<DWORD>(offset >> 32);
+        DWORD count = static_cast<DWORD>(std::min<size_t>(operation.size - done, 1u << 30));
+        DWORD moved = 0;
+        HANDLE file = reinterpret_cast<HANDLE>(operation.file);
+        BOOL isOk = operation.isWrite ? WriteFile(file, operation.data + done, count, &moved, &overlapped) : ::ReadFile(file, operation.data + done, count, &moved, &overlapped);
+        if (!isOk || moved == 0) return false;
+#else
+        int descriptor = static_cast<int>(operation.file);
+        off_t offset = static_cast<off_t>(operation.offset + done);
+        ssize_t moved = operation.isWrite ? pwrite(descriptor, operation.data + done, operation.size - done, offset) : pread(descriptor, operation.data + done, operation.size - done, offset);
+        if (moved < 0 && errno == EINTR) continue;
+        if (moved <= 0) return false;
+#endif
+        done += static_cast<size_t>(moved);
+    }
+    return true;
+}
+
+AsyncIO::FileHandle AsyncIO::OpenForWriting(const std::string& filename, bool isTruncated) {
+#ifdef _WIN32
+    HANDLE file = CreateFileA(filename.c_str(), GENERIC_WRITE, FILE_SHARE_READ, nullptr, isTruncated ? CREATE_ALWAYS : OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+    return file == INVALID_HANDLE_VALUE ? InvalidFile : reinterpret_cast<FileHandle>(file);
+#else
+    int descriptor = open(filename.c_str(), O_WRONLY | O_CREAT | O_CLOEXEC | (isTruncated ? O_TRUNC : 0), 0644);
+    return descriptor < 0 ? InvalidFile : descriptor;
+#endif
+}
+
+bool AsyncIO::ReplaceFile(const std::string& from, const std::string& to) {
+#ifdef _WIN32
+    if (MoveFileExA(from.c_str(), to.c_str(), MOVEFILE_REPLACE_EXISTING)) return true;
+    // a file that is still mapped can't be replaced, but MappedFile shares it for deletion, so it can be renamed aside and deleted,
+    // it then goes away once its last mapping is closed. an earlier aside may still be waiting for that, so the name is varied
+    for (int attempt = 0; attempt < 16; ++attempt) {
+        std::string aside = to + ".old" + std::to_string(attempt);
+        if (!MoveFileExA(to.c_str(), aside.c_str(), 0)) continue;
+        if (!MoveFileExA(from.c_str(), to.c_str(), 0)) {
+            // the new file couldn't take its place (something may hold it open), so the old one goes back and nothing is lost
+            MoveFileExA(aside.c_str(), to.c_str(), 0);
+            return false;
+        }
+        DeleteFileA(aside.c_str());
+        return true;
+    }
+    return false;
+#else
+    // the old file lives on for mappings of it until they are closed
+    return std::rename(from.c_str(), to.c_str()) == 0;
+#endif
+}
+
+AsyncIO::FileHandle AsyncIO::OpenForReading(const std::string& filename) {
+#ifdef _WIN32
+    HANDLE file = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    return file == INVALID_HANDLE_VALUE ? InvalidFile : reinterpret_cast<FileHandle>(file);
+#else
+    int descriptor = open(filename.c_str(), O_RDONLY | O_CLOEXEC);
+    return descriptor < 0 ? InvalidFile : descriptor;
+#endif
+}
+
+bool AsyncIO::Close(FileHandle file) {
+#ifdef _WIN32
+    return CloseHandle(reinterpret_cast<HANDLE>(file)) != 0;
+#else
+    return close(static_cast<int>(file)) == 0;     // delayed write errors of some file systems only show up here
+#endif
+}
+
+std::uint64_t AsyncIO::GetFileSize(FileHandle file) {
+#ifdef _WIN32
+    LARGE_INTEGER size;
+    return GetFileSizeEx(reinterpret_cast<HANDLE>(file), &size) ? static_cast<std::uint64_t>(size.QuadPart) : 0;
+#else
+    struct stat status;
+    return fstat(static_cast<int>(file), &status) == 0 ? static_cast<std::uint64_t>(status.st_size) : 0;
+#endif
+}
+
+bool AsyncIO::ReadFile(const std::string& filename, std::vector<char>& data) {
+    FileHandle file = OpenForReading(filename);
+    if (file == InvalidFile) return false;
+    data.resize(static_cast<size_t>(GetFileSize(file)));
+    std::vector<IoOperation> operations;
+    for (size_t offset = 0; offset < data.size(); offset += BlockSize) {
+        operations.push_back({ file, offset, data.data() + offset, std::min(BlockSize, data.size() - offset), false, nullptr });
+    }
+    bool isRead = Submit(std::move(operations))->Wait();
+    Close(file);
+    return isRead;
+}
+
+void AsyncIO::RecordSubmit(size_t count) {
+    std::lock_guard<std::mutex> lock(statsMutex);
+    if (inFlight == 0) busyStart = std::chrono::steady_clock::now();
+    inFlight += count;
+    ++stats.batches;
+}
+
+void AsyncIO::RecordCompletion(const IoOperation& operation, std::chrono::steady_clock::time_point submitted, bool isDone) {
+    std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+    double latency = std::chrono::duration<double>(now - submitted).count();
+    std::lock_guard<std::mutex> lock(statsMutex);
+    if (operation.isWrite) {
+        ++stats.writes;
+        if (isDone) stats.bytesWritten += operation.size;
+    }
+    else {
+        ++stats.reads;
+        if (isDone) stats.bytesRead += operation.size;
+    }
+    stats.totalLatency += latency;
+    stats.maxLatency = std::max(stats.maxLatency, latency);
+    if (--inFlight == 0) { stats.busySeconds += std::chrono::duration<double>(now - busyStart).count(); }
+}
+
+void AsyncIO::RecordFile(double seconds, double waitSeconds) {
+    std::lock_guard<std::mutex> lock(statsMutex);
+    ++stats.files;
+    stats.fileSeconds += seconds;
+    stats.waitSeconds += waitSeconds;
+}
+
+AsyncIO::Stats AsyncIO::GetStats() const {
+    std::lock_guard<std::mutex> lock(statsMutex);
+    return stats;
+}
+
+void AsyncIO::PrintStats(std::ostream& out) const {
+    Stats current = GetStats();
+    const double megabyte = 1024.0 * 1024.0;
+    std::uint64_t operations = current.writes + current.reads;
+    out << "File io (" << GetBackendName() << "): " << std::fixed << std::setprecision(1)
+        << current.writes << " writes " << current.bytesWritten / megabyte << " MB, "
+        << current.reads << " reads " << current.bytesRead / megabyte << " MB, in " << current.batches << " batches\n";
+    out << "  disk busy " << current.busySeconds * 1000.0 << " ms";
+    if (current.busySeconds > 0.0) out << ", " << (current.bytesWritten + current.bytesRead) / megabyte / current.busySeconds << " MB/s while busy";
+    if (operations > 0) out << ", latency " << std::setprecision(3) << current.totalLatency * 1000.0 / operations << " ms average " << current.maxLatency * 1000.0 << " ms max";
+    out << "\n  " << current.files << " files written in " << std::setprecision(1) << current.fileSeconds * 1000.0 << " ms, "
+        << current.waitSeconds * 1000.0 << " ms of it waiting on the disk\n";
+    out.unsetf(std::ios::floatfield);
+}
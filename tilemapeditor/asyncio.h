@@ -0,0 +1,102 @@
+#ifndef ASYNCIO_H
+#define ASYNCIO_H
+
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <vector>
+#include "threadpool.h"
+
+// one positioned read or write of a buffer, the owner keeps the buffer alive until the operation completed
+struct IoOperation {
+    std::intptr_t file;
+    std::uint64_t offset;
+    char* data;
+    size_t size;
+    bool isWrite;
+    std::shared_ptr<const void> owner;
+};
+
+// completion of operations submitted together
+class IoTicket {
+private:
+    friend class AsyncIO;
+    std::mutex mutex;
+    std::condition_variable finished;
+    size_t pending = 0;
+    bool isFailed = false;
+    std::function<void(bool)> onDone;   // posted to the main thread once the last operation completed
+    TaskGroup tasks;    // the operations, when they run on the thread pool
+    void Complete(bool isDone);
+public:
+    ~IoTicket() { Wait(); }     // the backend still points at a ticket until its operations completed
+    bool Wait();    // returns whether every operation transferred all of its bytes
+    bool IsDone();
+};
+
+// file i/o of saves and loads: operations are handed over in batches and complete in the background
+// on linux a shared io_uring takes every batch with a single system call and a completion thread collects the results,
+// elsewhere (or when the kernel refuses a ring or lacks its read and write opcodes) the operations run as tasks on the thread pool
+// either way the transfers are buffered i/o through the page cache, blocks only line up with BlockSize in the file, not in memory
+// every operation is counted and timed, so the time a save spends on the disk can be told apart from the time spent encoding
+class AsyncIO {
+public:
+    typedef std::intptr_t FileHandle;
+    static const FileHandle InvalidFile = -1;
+    static const size_t BlockSize = 1 << 20;    // large transfers are split into blocks of this size, ending on multiples of it in the file
+    struct Stats {
+        std::uint64_t writes = 0;
+        std::uint64_t reads = 0;
+        std::uint64_t bytesWritten = 0;
+        std::uint64_t bytesRead = 0;
+        std::uint64_t batches = 0;
+        double busySeconds = 0.0;   // time with at least one operation in flight
+        double totalLatency = 0.0;  // submission to completion, summed over operations
+        double maxLatency = 0.0;
+        std::uint64_t files = 0;    // files written through a FileWriter
+        double fileSeconds = 0.0;   // from opening to finishing those files
+        double waitSeconds = 0.0;   // part of it the writers spent blocked on their writes
+    };
+private:
+    struct Ring;    // io_uring state, only defined where the backend is built
+    std::unique_ptr<Ring> ring;
+    mutable std::mutex statsMutex;
+    Stats stats;
+    size_t inFlight = 0;    // guarded by statsMutex, together with busyStart
+    std::chrono::steady_clock::time_point busyStart;
+
+    static bool Transfer(const IoOperation& operation);     // blocking fallback, loops until every byte moved
+    void RecordSubmit(size_t count);
+    void RecordCompletion(const IoOperation& operation, std::chrono::steady_clock::time_point submitted, bool isDone);
+    bool StartRing();
+    void StopRing();
+    void RunRingCompletions();
+    void SubmitToRing(std::vector<IoOperation>& operations, const std::shared_ptr<IoTicket>& ticket);
+public:
+    AsyncIO();
+    ~AsyncIO();
+    AsyncIO(const AsyncIO&) = delete;
+    AsyncIO& operator=(const AsyncIO&) = delete;
+
+    static AsyncIO& GetShared();
+    const char* GetBackendName() const { return ring ? "io_uring" : "thread pool"; }
+    FileHandle OpenForWriting(const std::string& filename, bool isTruncated);   // created when missing
+    FileHandle OpenForReading(const std::string& filename);
+    bool Close(FileHandle file);
+    static bool ReplaceFile(const std::string& from, const std::string& to);   // renames from over to, even while to is still mapped
+    std::uint64_t GetFileSize(FileHandle file);
+    // onDone, when given, runs on the main thread (in ThreadPool::RunMainThreadCallbacks) with the result Wait would return,
+    // so the editor loop hears about the batch without polling the ticket
+    std::shared_ptr<IoTicket> Submit(std::vector<IoOperation> operations, std::function<void(bool)> onDone = nullptr);
+    bool ReadFile(const std::string& filename, std::vector<char>& data);    // the whole file in one batch of block reads, false when it can't be opened or read
+    void RecordFile(double seconds, double waitSeconds);
+    Stats GetStats() const;
+    void PrintStats(std::ostream& out) const;
+};
+#endif
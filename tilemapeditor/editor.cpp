@@ -1,6 +1,9 @@
 #include "editor.h"
 #include "ui.h"
 #include "layer.h"
+#include "threadpool.h"
+#include <algorithm>
+#include <cmath>
 
 // default editor constructor because editor needs to be constructed first, and then i can freely initialize other dependencies e.g. ui
 Editor::Editor()
@@ -8,9 +11,6 @@ Editor::Editor()
 {
     auto windowWidth = static_cast<float>(window.getSize().x);
     auto windowHeight = static_cast<float>(window.getSize().y);
-    // initialize default zoom level to match normal rendering
-    currentZoomIndex = 1; // index 1 corresponds to zoom level 16 (normal rendering)
-    float defaultZoomFactor = static_cast<float>(zoomLevels[currentZoomIndex]) / zoomLevels[0];
     // ui view initialization (takes up the full height and the left 25% of the window)
     uiView.setViewport(sf::FloatRect(0.25f, 0.75f, 0.75f, 0.25f));
     uiView.setSize(windowWidth * 0.75f, windowHeight); // match the logical size to prevent weird stretching
@@ -43,125 +43,185 @@ void Editor::InitializeClass() {
     tileAtlas = new TileAtlas(*this);
     tileAtlas->Initialize();
     tileMap = new TileMap(*this, *tileAtlas);
+    renderer = new Renderer(window, *tileAtlas);
+    scheduler = new FrameScheduler();
     // tileMap->Initialize();
 
 }
 
 void Editor::Run() {
     sf::Clock clock;
-    while (window.isOpen()) {
+    renderer->SetFrameLimit(frameLimit);   // caps the frame rate while painting or panning keeps redrawing every frame
+    renderer->Start();  // from here on only the render thread draws to the window
+    while (!isCloseRequested) {
+        // when nothing is dirty, nothing is animating and no long operation is running, sleep until the next event instead of spinning
+        if (!needsRedraw && animationCount == 0 && !scheduler->IsBusy()) {
+            sf::Event event;
+            // the wait also ends when an autosave is due or a pool task hands a result back to the main thread
+            std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::time_point::max();
+            if (tileMap->IsAutosavePending()) {
+                deadline = std::chrono::steady_clock::now() + std::chrono::microseconds(std::max<sf::Int64>(tileMap->GetTimeUntilAutosave().asMicroseconds(), 0));
+            }
+            if (WaitForEvent(event, deadline)) {
+                float deltaTime = clock.restart().asSeconds();
+                inputDelay -= deltaTime;
+                ProcessEvent(event, deltaTime);
+            }
+        }
         float deltaTime = clock.restart().asSeconds();  // use deltatime to make actions relative to time not framerate
         HandleEvents(deltaTime);
-        Render(window);
+        tileMap->UpdateSaves();    // pick up finished background saves and start autosaves
+        tileMap->UpdateLoad(); // show layers a background load has read so far
+        ThreadPool::GetShared().RunMainThreadCallbacks();  // completions that pool tasks handed back to the main thread
+        // the next slice of long operations, input is handled again before the one after, and their progress on screen moves on
+        if (scheduler->RunFor(taskBudget)) { RequestRedraw(); }
+        // only redraw when input, an edit, a camera change or an animation dirtied a view
+        if (needsRedraw || animationCount > 0) {
+            // the renderer takes one frame at a time, while it is still busy input keeps being handled and the frame is captured a little later
+            if (renderer->IsReady()) {
+                needsRedraw = false;
+                renderer->Submit(CaptureFrame());
+            }
+            else {
+                renderer->WaitUntilReady(std::chrono::milliseconds(2));
+            }
+        }
     }
+    renderer->Stop();
+    window.close();
+    tileMap->CancelLoad();
+    scheduler->FinishAll();    // e.g. a save still waiting for its chunks to be copied out of the mapped file
+    tileMap->WaitForSaves();   // let a save that is still being written finish before the editor exits
+}
+
+bool Editor::WaitForEvent(sf::Event& event, std::chrono::steady_clock::time_point deadline) {
+    // waitEvent can neither time out nor be woken by another thread, and sfml implements it by checking for events every 10 ms,
+    // so the same checks are made here with the sleeps in between spent waiting on the pool's callbacks
+    ThreadPool& pool = ThreadPool::GetShared();
+    while (!window.pollEvent(event)) {
+        std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+        if (now >= deadline || pool.HasMainThreadCallbacks()) return false;
+        if (pool.WaitForMainThreadCallbacks(std::min(deadline, now + std::chrono::milliseconds(10)))) return false;
+    }
+    return true;
 }
 
 void Editor::HandleEvents(float deltaTime) {
     sf::Event event;
     inputDelay -= deltaTime;
+    while (window.pollEvent(event)) {
+        ProcessEvent(event, deltaTime);
+    }
+}
+
+void Editor::ProcessEvent(const sf::Event& event, float deltaTime) {
     // track mouse drag state for painting tiles, atlas selection and panning
     bool isLeftMouseDragging = sf::Mouse::isButtonPressed(sf::Mouse::Left);
     bool isRightMouseDragging = sf::Mouse::isButtonPressed(sf::Mouse::Right);
     bool isMiddleMouseDragging = sf::Mouse::isButtonPressed(sf::Mouse::Middle);
-    while (window.pollEvent(event)) {
-        // get the mouse position within the window and convert it to world coordinates so we know which view the mouse was in when clicked
-        sf::Vector2i mousePos = sf::Mouse::getPosition(window);
-        sf::Vector2f mouseWorldPos = window.mapPixelToCoords(mousePos);
-        sf::Vector2f atlasMousePos = window.mapPixelToCoords(mousePos, atlasView);
-        sf::Vector2f layerMousePos = window.mapPixelToCoords(mousePos, layerView);
-        sf::Vector2f uiMousePos = window.mapPixelToCoords(mousePos, uiView);
-        if (event.type == sf::Event::Closed) { window.close(); }
-        int layerIndex = -1;    // default invalid index
-        // key inputs to switch between the layers of a TileMap instance
-        if (sf::Keyboard::isKeyPressed(sf::Keyboard::Num1)) { layerIndex = 0; }
-        if (sf::Keyboard::isKeyPressed(sf::Keyboard::Num2)) { layerIndex = 1; }
-        if (sf::Keyboard::isKeyPressed(sf::Keyboard::Num3)) { layerIndex = 2; }
-        if (sf::Keyboard::isKeyPressed(sf::Keyboard::Num4)) { layerIndex = 3; }
-        if (sf::Keyboard::isKeyPressed(sf::Keyboard::Num5)) { layerIndex = 4; }
-        if (sf::Keyboard::isKeyPressed(sf::Keyboard::Num6)) { layerIndex = 5; }
-        // now set the current layer with layerIndex variable by calling SetCurrentLayer and passing it
-        if (layerIndex != -1) { tileMap->SetCurrentLayer(layerIndex); }
-        // ATLAS VIEW MOUSE INPUTS
-        if (GetViewportBounds(atlasView, window).contains(static_cast<sf::Vector2f>(mousePos))) {
-            if (event.type == sf::Event::MouseButtonPressed) {
-                if (event.mouseButton.button == sf::Mouse::Left) {}
-                if (event.mouseButton.button == sf::Mouse::Right) { tileAtlas->HandleSelection(atlasMousePos, true, deltaTime); }
-                if (event.mouseButton.button == sf::Mouse::Middle) { tileAtlas->HandlePanning(atlasMousePos, true, deltaTime); }
-            }
-            else if (event.type == sf::Event::MouseButtonReleased) {
-                if (event.mouseButton.button == sf::Mouse::Left) {}
-                if (event.mouseButton.button == sf::Mouse::Right) { tileAtlas->HandleSelection(atlasMousePos, false, deltaTime); }
-                if (event.mouseButton.button == sf::Mouse::Middle) { tileAtlas->HandlePanning(atlasMousePos, false, deltaTime); }
-            }
-            else if (event.type == sf::Event::MouseMoved) {
-                if (isRightMouseDragging) { tileAtlas->HandleSelection(atlasMousePos, true, deltaTime); }
-                if (isMiddleMouseDragging) { tileAtlas->HandlePanning(atlasMousePos, true, deltaTime); }
-            }
-            else if (event.type == sf::Event::MouseWheelMoved) {
-                if (event.mouseWheel.delta > 0) { HandleAtlasZoom(atlasView, event.mouseWheel.delta, atlasOriginalViewSize); }  // zoom in
-                else if (event.mouseWheel.delta < 0) { HandleAtlasZoom(atlasView, event.mouseWheel.delta, atlasOriginalViewSize); }  // zoom out
-            }
-        }   // LAYER VIEW MOUSE INPUTS
-        else if (GetViewportBounds(layerView, window).contains(static_cast<sf::Vector2f>(mousePos))) {
-            if (event.type == sf::Event::MouseButtonPressed) {
-                if (event.mouseButton.button == sf::Mouse::Left) { tileMap->HandleTilePlacement(layerMousePos); }
-                if (event.mouseButton.button == sf::Mouse::Right) { /*tileMap->HandleSelection(true, deltaTime);*/ }
-                if (event.mouseButton.button == sf::Mouse::Middle) { tileMap->HandlePanning(layerMousePos, true, deltaTime); }
-            }
-            else if (event.type == sf::Event::MouseButtonReleased) {
-                if (event.mouseButton.button == sf::Mouse::Left) {}
-                if (event.mouseButton.button == sf::Mouse::Right) { /*tileMap->HandleSelection(atlasMousePos, false, deltaTime);*/ }
-                if (event.mouseButton.button == sf::Mouse::Middle) { tileMap->HandlePanning(layerMousePos, false, deltaTime); }
-            }
-            else if (event.type == sf::Event::MouseMoved) {
-                if (isLeftMouseDragging) { tileMap->HandleTilePlacement(layerMousePos); }
-                if (isMiddleMouseDragging) { tileMap->HandlePanning(layerMousePos, true, deltaTime); }
-            }
-            else if (event.type == sf::Event::MouseWheelMoved) {
-                if (event.mouseWheel.delta > 0) { HandleLayerZoom(layerView, event.mouseWheel.delta, layerOriginalViewSize); }  // zoom in
-                else if (event.mouseWheel.delta < 0) { HandleLayerZoom(layerView, event.mouseWheel.delta, layerOriginalViewSize); }  // zoom out
-            }
-        }   // UI VIEW MOUSE INPUTS
-        else if (GetViewportBounds(uiView, window).contains(static_cast<sf::Vector2f>(mousePos))) {
-            if (event.type == sf::Event::MouseButtonPressed) {
-                if (event.mouseButton.button == sf::Mouse::Left && inputDelay <= 0.f) { ui->HandleInteraction(uiMousePos, window); }
-                if (event.mouseButton.button == sf::Mouse::Right) {}
-                if (event.mouseButton.button == sf::Mouse::Middle) {}
-            }
-            else if (event.type == sf::Event::MouseButtonReleased) {
-                if (event.mouseButton.button == sf::Mouse::Left) {}
-                if (event.mouseButton.button == sf::Mouse::Right) {}
-                if (event.mouseButton.button == sf::Mouse::Middle) {}
-            }
+    // get the mouse position within the window and convert it to world coordinates so we know which view the mouse was in when clicked
+    sf::Vector2i mousePos = sf::Mouse::getPosition(window);
+    sf::Vector2f mouseWorldPos = window.mapPixelToCoords(mousePos);
+    sf::Vector2f atlasMousePos = window.mapPixelToCoords(mousePos, atlasView);
+    sf::Vector2f layerMousePos = window.mapPixelToCoords(mousePos, layerView);
+    sf::Vector2f uiMousePos = window.mapPixelToCoords(mousePos, uiView);
+    if (event.type == sf::Event::Closed) { isCloseRequested = true; }
+    // the window contents may have been lost or stretched, so draw everything again
+    if (event.type == sf::Event::Resized || event.type == sf::Event::GainedFocus) { RequestRedraw(); }
+    int layerIndex = -1;    // default invalid index
+    // key inputs to switch between the layers of a TileMap instance
+    if (sf::Keyboard::isKeyPressed(sf::Keyboard::Num1)) { layerIndex = 0; }
+    if (sf::Keyboard::isKeyPressed(sf::Keyboard::Num2)) { layerIndex = 1; }
+    if (sf::Keyboard::isKeyPressed(sf::Keyboard::Num3)) { layerIndex = 2; }
+    if (sf::Keyboard::isKeyPressed(sf::Keyboard::Num4)) { layerIndex = 3; }
+    if (sf::Keyboard::isKeyPressed(sf::Keyboard::Num5)) { layerIndex = 4; }
+    if (sf::Keyboard::isKeyPressed(sf::Keyboard::Num6)) { layerIndex = 5; }
+    // now set the current layer with layerIndex variable by calling SetCurrentLayer and passing it
+    if (layerIndex != -1) { tileMap->SetCurrentLayer(layerIndex); }
+    // a rect fill follows the mouse until the button that started it is released, even once it left the layer view,
+    // other buttons (like panning with the middle one) keep working during the drag
+    bool isShiftPressed = sf::Keyboard::isKeyPressed(sf::Keyboard::LShift) || sf::Keyboard::isKeyPressed(sf::Keyboard::RShift);
+    bool isRectFillRelease = event.type == sf::Event::MouseButtonReleased && tileMap->IsRectFillButton(event.mouseButton.button);
+    if (tileMap->IsFillingRect() && (event.type == sf::Event::MouseMoved || isRectFillRelease)) {
+        tileMap->HandleRectFill(layerMousePos, event.type == sf::Event::MouseMoved, false);
+        bool isOverLayerView = GetViewportBounds(layerView, window).contains(static_cast<sf::Vector2f>(mousePos));
+        if (event.type == sf::Event::MouseMoved && isMiddleMouseDragging && isOverLayerView) { tileMap->HandlePanning(mousePos, true, deltaTime); }
+    }   // ATLAS VIEW MOUSE INPUTS
+    else if (GetViewportBounds(atlasView, window).contains(static_cast<sf::Vector2f>(mousePos))) {
+        if (event.type == sf::Event::MouseButtonPressed) {
+            if (event.mouseButton.button == sf::Mouse::Left) {}
+            if (event.mouseButton.button == sf::Mouse::Right) { tileAtlas->HandleSelection(atlasMousePos, true, deltaTime); }
+            if (event.mouseButton.button == sf::Mouse::Middle) { tileAtlas->HandlePanning(mousePos, true, deltaTime); }
+        }
+        else if (event.type == sf::Event::MouseButtonReleased) {
+            if (event.mouseButton.button == sf::Mouse::Left) {}
+            if (event.mouseButton.button == sf::Mouse::Right) { tileAtlas->HandleSelection(atlasMousePos, false, deltaTime); }
+            if (event.mouseButton.button == sf::Mouse::Middle) { tileAtlas->HandlePanning(mousePos, false, deltaTime); }
+        }
+        else if (event.type == sf::Event::MouseMoved) {
+            if (isRightMouseDragging) { tileAtlas->HandleSelection(atlasMousePos, true, deltaTime); }
+            if (isMiddleMouseDragging) { tileAtlas->HandlePanning(mousePos, true, deltaTime); }
+        }
+        else if (event.type == sf::Event::MouseWheelMoved) {
+            if (event.mouseWheel.delta > 0) { HandleAtlasZoom(atlasView, event.mouseWheel.delta, atlasOriginalViewSize, mousePos); }  // zoom in
+            else if (event.mouseWheel.delta < 0) { HandleAtlasZoom(atlasView, event.mouseWheel.delta, atlasOriginalViewSize, mousePos); }  // zoom out
+        }
+    }   // LAYER VIEW MOUSE INPUTS
+    else if (GetViewportBounds(layerView, window).contains(static_cast<sf::Vector2f>(mousePos))) {
+        if (event.type == sf::Event::MouseButtonPressed) {
+            // with shift held the buttons drag a rect to fill or erase instead of painting single tiles
+            if (event.mouseButton.button == sf::Mouse::Left && isShiftPressed) { tileMap->HandleRectFill(layerMousePos, true, false); }
+            else if (event.mouseButton.button == sf::Mouse::Left) { tileMap->HandleTilePlacement(layerMousePos); }
+            if (event.mouseButton.button == sf::Mouse::Right && isShiftPressed) { tileMap->HandleRectFill(layerMousePos, true, true); }
+            else if (event.mouseButton.button == sf::Mouse::Right) { tileMap->HandleTileRemoval(layerMousePos); }
+            if (event.mouseButton.button == sf::Mouse::Middle) { tileMap->HandlePanning(mousePos, true, deltaTime); }
+        }
+        else if (event.type == sf::Event::MouseButtonReleased) {
+            if (event.mouseButton.button == sf::Mouse::Left) {}
+            if (event.mouseButton.button == sf::Mouse::Right) { /*tileMap->HandleSelection(atlasMousePos, false, deltaTime);*/ }
+            if (event.mouseButton.button == sf::Mouse::Middle) { tileMap->HandlePanning(mousePos, false, deltaTime); }
+        }
+        else if (event.type == sf::Event::MouseMoved) {
+            if (isLeftMouseDragging) { tileMap->HandleTilePlacement(layerMousePos); }
+            if (isRightMouseDragging) { tileMap->HandleTileRemoval(layerMousePos); }
+            if (isMiddleMouseDragging) { tileMap->HandlePanning(mousePos, true, deltaTime); }
+        }
+        else if (event.type == sf::Event::MouseWheelMoved) {
+            if (event.mouseWheel.delta > 0) { HandleLayerZoom(layerView, event.mouseWheel.delta, layerOriginalViewSize, mousePos); }  // zoom in
+            else if (event.mouseWheel.delta < 0) { HandleLayerZoom(layerView, event.mouseWheel.delta, layerOriginalViewSize, mousePos); }  // zoom out
+        }
+    }   // UI VIEW MOUSE INPUTS
+    else if (GetViewportBounds(uiView, window).contains(static_cast<sf::Vector2f>(mousePos))) {
+        if (event.type == sf::Event::MouseButtonPressed) {
+            if (event.mouseButton.button == sf::Mouse::Left && inputDelay <= 0.f) { ui->HandleInteraction(uiMousePos); }
+            if (event.mouseButton.button == sf::Mouse::Right) {}
+            if (event.mouseButton.button == sf::Mouse::Middle) {}
+        }
+        else if (event.type == sf::Event::MouseButtonReleased) {
+            if (event.mouseButton.button == sf::Mouse::Left) {}
+            if (event.mouseButton.button == sf::Mouse::Right) {}
+            if (event.mouseButton.button == sf::Mouse::Middle) {}
         }
-        ui->HandleTextInput(event);
-        // reset the input delay
-        inputDelay = 0.01f;
     }
+    ui->HandleTextInput(event);
+    // reset the input delay
+    inputDelay = 0.01f;
 }
 
-void Editor::Render(sf::RenderWindow& window) {
-    window.clear();
-    // ui rendering
-    window.setView(uiView);
-    ui->DrawUI(window);
-    ui->DrawTextInput(window);
-    // layer rendering
-    window.setView(layerView);
-    if (tileMap->showMergedLayers) {
-        tileMap->MergeAllLayers(window, true);
-    }
-    tileMap->DrawLayerGrid(window, tileMap->GetCurrentLayerIndex());
-    // atlas rendering
-    window.setView(atlasView);
-    tileAtlas->DrawAtlas(window);
-    tileAtlas->DrawDragSelection(window);
-    // reset to default view for separators
-    window.setView(window.getDefaultView());
-    window.draw(verticalSeparator);
-    window.draw(horizontalSeparator);
-    // display to window
-    window.display();
+std::shared_ptr<const RenderFrame> Editor::CaptureFrame() {
+    // everything the render thread needs is copied into the frame, so editing can go on while it is drawn
+    std::shared_ptr<RenderFrame> frame = std::make_shared<RenderFrame>();
+    frame->windowView = window.getDefaultView();
+    frame->uiView = uiView;
+    frame->layerView = layerView;
+    frame->atlasView = atlasView;
+    // ui, layers and atlas in their own views, then the separators
+    ui->AddToFrame(*frame);
+    tileMap->AddToFrame(*frame);
+    tileAtlas->AddToFrame(*frame);
+    frame->windowItems.push_back(std::make_shared<sf::RectangleShape>(verticalSeparator));
+    frame->windowItems.push_back(std::make_shared<sf::RectangleShape>(horizontalSeparator));
+    return frame;
 }
 
 sf::FloatRect Editor::GetViewportBounds(const sf::View& view, const sf::RenderWindow& window) {
@@ -176,25 +236,69 @@ sf::FloatRect Editor::GetViewportBounds(const sf::View& view, const sf::RenderWi
     );
 }
 
-void Editor::HandleAtlasZoom(sf::View& view, float delta, const sf::Vector2f& originalSize) {
-    int newZoomIndex = currentZoomIndex + (delta < 0 ? -1 : 1); // set new zoom index based on if delta is positive or negative, if delta is negative, zoom out, and vice versa
-    newZoomIndex = clamp(newZoomIndex, 0, static_cast<int>(zoomLevels.size()) - 1);
+sf::FloatRect Editor::GetVisibleArea(const sf::View& view) const {
+    // the area of the view's coordinate space that ends up on screen, used to skip drawing anything outside of it
+    sf::Vector2f size = view.getSize();
+    return sf::FloatRect(view.getCenter() - size / 2.f, size);
+}
 
-    if (newZoomIndex != currentZoomIndex) {
-        currentZoomIndex = newZoomIndex;
-        atlasScaleFactor = static_cast<float>(zoomLevels[currentZoomIndex]) / zoomLevels[0]; // Scale relative to the base
-        tileAtlas->UpdateTileSize(atlasScaleFactor);
-    }
+void Editor::HandleAtlasZoom(sf::View& view, float delta, const sf::Vector2f& originalSize, const sf::Vector2i& mousePos) {
+    ZoomViewAt(view, atlasZoom, delta, originalSize, mousePos);
 }
 
-void Editor::HandleLayerZoom(sf::View& view, float delta, const sf::Vector2f& originalSize) {
-    int newZoomIndex = currentZoomIndex + (delta < 0 ? -1 : 1);
-    newZoomIndex = clamp(newZoomIndex, 0, static_cast<int>(zoomLevels.size()) - 1);
+void Editor::HandleLayerZoom(sf::View& view, float delta, const sf::Vector2f& originalSize, const sf::Vector2i& mousePos) {
+    ZoomViewAt(view, layerZoom, delta, originalSize, mousePos);
+}
+
+void Editor::ZoomViewAt(sf::View& view, float& zoom, float delta, const sf::Vector2f& originalSize, const sf::Vector2i& mousePos) {
+    // each wheel notch scales the zoom by zoomStep, positive delta zooms in and negative delta zooms out
+    float newZoom = clamp(zoom * std::pow(zoomStep, delta), minZoom, maxZoom);
+    if (newZoom == zoom) return;
+    // resize the view around the point under the cursor so that point stays where it is on screen
+    sf::Vector2f before = window.mapPixelToCoords(mousePos, view);
+    zoom = newZoom;
+    view.setSize(originalSize / zoom);
+    sf::Vector2f after = window.mapPixelToCoords(mousePos, view);
+    view.move(before - after);
+    RequestRedraw();
+}
 
-    if (newZoomIndex != currentZoomIndex) {
-        currentZoomIndex = newZoomIndex;
-        float scaleFactor = static_cast<float>(zoomLevels[currentZoomIndex]) / zoomLevels[0]; // scale relative to base level 
-        tileMap->UpdateTileScale(scaleFactor);
+void Editor::PanView(sf::View& view, const sf::Vector2i& from, const sf::Vector2i& to) {
+    // move the view by the world space distance the mouse travelled, so the content follows the cursor at any zoom
+    sf::Vector2f delta = window.mapPixelToCoords(from, view) - window.mapPixelToCoords(to, view);
+    if (delta.x == 0.f && delta.y == 0.f) return;
+    view.move(delta);
+    RequestRedraw();
+}
+
+RenderFrame::Item Editor::CreateGrid(const sf::View& view, const sf::IntRect& cells, float tileSize) const {
+    // all lines go into one vertex array so the whole grid is a single draw call
+    std::shared_ptr<sf::VertexArray> gridLines = std::make_shared<sf::VertexArray>(sf::Lines);
+    if (cells.width <= 0 || cells.height <= 0) return gridLines;
+    // when zoomed far out, only every step-th line is drawn so cells never get denser than minGridSpacing pixels on screen
+    const float minGridSpacing = 4.f;
+    int step = 1;
+    while (step < (1 << 20) && tileSize * step < minGridSpacing * GetPixelSize(view)) { step *= 2; }
+    sf::Color color(100, 100, 100, 150);
+    float left = cells.left * tileSize;
+    float top = cells.top * tileSize;
+    float right = (cells.left + cells.width) * tileSize;
+    float bottom = (cells.top + cells.height) * tileSize;
+    int firstColumn = cells.left + ((step - cells.left % step) % step); // first multiple of step inside the cells
+    for (int x = firstColumn; x <= cells.left + cells.width; x += step) {
+        gridLines->append(sf::Vertex(sf::Vector2f(x * tileSize, top), color));
+        gridLines->append(sf::Vertex(sf::Vector2f(x * tileSize, bottom), color));
+    }
+    int firstRow = cells.top + ((step - cells.top % step) % step);
+    for (int y = firstRow; y <= cells.top + cells.height; y += step) {
+        gridLines->append(sf::Vertex(sf::Vector2f(left, y * tileSize), color));
+        gridLines->append(sf::Vertex(sf::Vector2f(right, y * tileSize), color));
     }
+    return gridLines;
+}
+
+float Editor::GetPixelSize(const sf::View& view) const {
+    // world units covered by one screen pixel in a view, used to keep lines one pixel wide at any zoom
+    return view.getSize().x / (view.getViewport().width * window.getSize().x);
 }
 
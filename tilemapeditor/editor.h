@@ -5,7 +5,10 @@
 #include <SFML/System/Vector2.hpp>
 #include <SFML/Graphics/Image.hpp>
 #include <SFML/Graphics/Texture.hpp>
+#include <memory>
 #include "tileatlas.h"
+#include "renderer.h"
+#include "framescheduler.h"
 
 class UI;
 class TileMap;
@@ -24,33 +27,54 @@ private:
     sf::RectangleShape verticalSeparator, horizontalSeparator;
     // variable to prevent too many inputs registering each frame
     float inputDelay = 0.05f;
+    // damage tracking: the loop waits for the next event until something sets needsRedraw or an animation is running
+    bool needsRedraw = true;
+    int animationCount = 0;
+    unsigned int frameLimit = 144;  // frame cap for continuous redraws while painting/panning, 0 disables it
+    std::chrono::microseconds taskBudget{ 5000 };   // main thread time long operations get per frame, short enough to stay under a 144 hz frame
+    bool isCloseRequested = false;  // the window is closed once the render thread has let go of it
     // use pointer to these classes to avoid circular dependencies
     UI* ui;
     TileMap* tileMap;
     TileAtlas* tileAtlas;
+    Renderer* renderer;     // draws the captured frames on its own thread
+    FrameScheduler* scheduler;  // runs long operations a slice per frame
 public:
-    // variables to track zooming
-    const std::vector<int> zoomLevels = { 1, 4, 8 };  // Adjusted for finer zoom steps
-    int currentZoomIndex = 0;  // start at the default zoom level (16)
-    float atlasScaleFactor = 1.0f;
-    const int baseTileSize = 16; // an unchangable tile size used as a reference for zooming
-    // variables to track the panning offset for the atlas and layer
-    sf::Vector2f atlasViewOffset = { 0.f, 0.f };
-    sf::Vector2f layerViewOffset = { 0.f, 0.f };
+    // camera zoom of each view, applied purely through the view size so tile geometry stays in world space
+    float atlasZoom = 1.0f;
+    float layerZoom = 1.0f;
+    const float minZoom = 0.25f;
+    const float maxZoom = 8.0f;
+    const float zoomStep = 1.15f;   // zoom multiplier per mouse wheel notch
+    const int baseTileSize = 16; // an unchangable tile size used as the world size of a tile
     // main editor functions
     Editor();
     void Run();
-    void Render(sf::RenderWindow& window);
+    std::shared_ptr<const RenderFrame> CaptureFrame();
     void HandleEvents(float deltaTime);
+    void ProcessEvent(const sf::Event& event, float deltaTime);
+    bool WaitForEvent(sf::Event& event, std::chrono::steady_clock::time_point deadline);    // false once the deadline passed or a pool task posted a callback
+    // called by anything that changes what is on screen
+    void RequestRedraw() { needsRedraw = true; }
+    // animations keep the loop redrawing every frame until they end
+    void BeginAnimation() { ++animationCount; }
+    void EndAnimation() { if (animationCount > 0) { --animationCount; } needsRedraw = true; }
+    void SetFrameLimit(unsigned int limit) { frameLimit = limit; renderer->SetFrameLimit(limit); }
     sf::FloatRect GetViewportBounds(const sf::View& view, const sf::RenderWindow& window);
-    void HandleAtlasZoom(sf::View& view, float delta, const sf::Vector2f& originalSize);
-    void HandleLayerZoom(sf::View& view, float delta, const sf::Vector2f& originalSize);
+    sf::FloatRect GetVisibleArea(const sf::View& view) const;
+    void HandleAtlasZoom(sf::View& view, float delta, const sf::Vector2f& originalSize, const sf::Vector2i& mousePos);
+    void HandleLayerZoom(sf::View& view, float delta, const sf::Vector2f& originalSize, const sf::Vector2i& mousePos);
+    void ZoomViewAt(sf::View& view, float& zoom, float delta, const sf::Vector2f& originalSize, const sf::Vector2i& mousePos);
+    void PanView(sf::View& view, const sf::Vector2i& from, const sf::Vector2i& to);
+    float GetPixelSize(const sf::View& view) const;
+    RenderFrame::Item CreateGrid(const sf::View& view, const sf::IntRect& cells, float tileSize) const;
     void InitializeClass();
     sf::RenderWindow& GetWindow() { return window; }
-    sf::View GetUIView() { return uiView; }
-    sf::View GetAtlasView() { return atlasView; }
-    sf::View GetLayerView() { return layerView; }
+    sf::View& GetUIView() { return uiView; }
+    sf::View& GetAtlasView() { return atlasView; }
+    sf::View& GetLayerView() { return layerView; }
     TileMap* GetTileMap() { return tileMap; }
+    FrameScheduler& GetScheduler() { return *scheduler; }
     float clamp(float value, float min, float max) {
         return std::max(min, std::min(max, value));
     }
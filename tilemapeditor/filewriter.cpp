@@ -0,0 +1,117 @@
+#include "filewriter.h"
+#include <algorithm>
+#include <cstdio>
+#include <iostream>
+
+FileWriter::FileWriter(const std::string& filename, std::uint64_t offset)
+    : io(AsyncIO::GetShared()), filename(filename), temporaryFilename(offset == 0 ? filename + ".tmp" : std::string()),
+    file(io.OpenForWriting(offset == 0 ? temporaryFilename : filename, offset == 0)), position(offset), stream(this), openTime(std::chrono::steady_clock::now())
+{
+    if (!IsOpen()) {
+        isFailed = true;
+        stream.setstate(std::ios::badbit);
+    }
+}
+
+void FileWriter::Write(const void* data, size_t size) {
+    if (!IsOpen()) return;
+    const char* bytes = static_cast<const char*>(data);
+    while (size > 0) {
+        if (!block) {
+            block = std::make_shared<std::vector<char>>();
+            blockOffset = position;
+        }
+        // the first block only runs up to the next block boundary, so a journal appended at any offset still writes whole blocks after it
+        size_t capacity = AsyncIO::BlockSize - static_cast<size_t>(blockOffset % AsyncIO::BlockSize);
+        if (block->capacity() < capacity) block->reserve(capacity);
+        size_t count = std::min(capacity - block->size(), size);
+        block->insert(block->end(), bytes, bytes + count);
+        bytes += count;
+        size -= count;
+        position += count;
+        if (block->size() == capacity) QueueBlock();
+    }
+    SubmitBatch();
+}
+
+void FileWriter::Write(std::shared_ptr<const std::vector<char>> data) {
+    if (!IsOpen() || data->empty()) return;
+    QueueBlock();   // what was appended before goes out with it
+    // the buffer is split on block boundaries, the operations only read from it and keep it alive until they are done
+    char* bytes = const_cast<char*>(data->data());
+    size_t done = 0;
+    while (done < data->size()) {
+        size_t count = std::min(data->size() - done, AsyncIO::BlockSize - static_cast<size_t>(position % AsyncIO::BlockSize));
+        batch.push_back({ file, position, bytes + done, count, true, data });
+        done += count;
+        position += count;
+    }
+    SubmitBatch();
+}
+
+void FileWriter::Skip(size_t size) {
+    QueueBlock();
+    position += size;
+}
+
+void FileWriter::WriteAt(std::uint64_t offset, const void* data, size_t size) {
+    if (!IsOpen() || size == 0) return;
+    std::shared_ptr<std::vector<char>> copy = std::make_shared<std::vector<char>>(static_cast<const char*>(data), static_cast<const char*>(data) + size);
+    batch.push_back({ file, offset, copy->data(), copy->size(), true, copy });
+    SubmitBatch();
+}
+
+void FileWriter::QueueBlock() {
+    if (!block || block->empty()) return;
+    batch.push_back({ file, blockOffset, block->data(), block->size(), true, block });
+    block.reset();
+}
+
+void FileWriter::SubmitBatch() {
+    if (batch.empty()) return;
+    // batches that are done are dropped, a writer far ahead of the disk waits for the oldest one
+    while (!tickets.empty() && tickets.front()->IsDone()) { WaitForTicket(); }
+    while (tickets.size() >= maxTickets) { WaitForTicket(); }
+    tickets.push_back(io.Submit(std::move(batch)));
+    batch.clear();
+}
+
+void FileWriter::WaitForTicket() {
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    if (!tickets.front()->Wait()) isFailed = true;
+    waitSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    tickets.erase(tickets.begin());
+}
+
+std::streamsize FileWriter::xsputn(const char* data, std::streamsize size) {
+    if (!IsOpen()) return 0;
+    Write(data, static_cast<size_t>(size));
+    return size;
+}
+
+FileWriter::int_type FileWriter::overflow(int_type character) {
+    // no put area is set up, so single characters end up here
+    if (traits_type::eq_int_type(character, traits_type::eof())) return traits_type::not_eof(character);
+    if (!IsOpen()) return traits_type::eof();
+    char byte = traits_type::to_char_type(character);
+    Write(&byte, 1);
+    return character;
+}
+
+bool FileWriter::Finish() {
+    if (isFinished) return !isFailed;
+    isFinished = true;
+    if (!IsOpen()) return false;
+    QueueBlock();
+    SubmitBatch();
+    while (!tickets.empty()) { WaitForTicket(); }
+    if (!io.Close(file)) isFailed = true;
+    file = AsyncIO::InvalidFile;
+    if (!temporaryFilename.empty()) {
+        if (!isFailed && !io.ReplaceFile(temporaryFilename, filename)) isFailed = true;
+        if (isFailed) { std::remove(temporaryFilename.c_str()); }   // the file that was there stays as it was
+    }
+    if (isFailed) { std::cerr << "Failed to write " << filename << "\n"; }
+    io.RecordFile(std::chrono::duration<double>(std::chrono::steady_clock::now() - openTime).count(), waitSeconds);
+    return !isFailed;
+}
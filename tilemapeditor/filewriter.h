@@ -0,0 +1,56 @@
+#ifndef FILEWRITER_H
+#define FILEWRITER_H
+
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <ostream>
+#include <streambuf>
+#include <string>
+#include <vector>
+#include "asyncio.h"
+
+// writes one file through AsyncIO while the caller keeps producing it
+// appended bytes are collected into blocks that end on multiples of AsyncIO::BlockSize, every full block goes out straight away,
+// so encoding the rest of a map overlaps with writing what is done. text writers such as JsonWriter use GetStream()
+class FileWriter : private std::streambuf {
+private:
+    AsyncIO& io;
+    std::string filename;
+    std::string temporaryFilename;  // a replaced file is written under this name and renamed over filename once complete, empty when writing in place
+    AsyncIO::FileHandle file;
+    std::uint64_t position;     // file offset the next byte goes to
+    std::shared_ptr<std::vector<char>> block;   // appended bytes that haven't been submitted yet
+    std::uint64_t blockOffset = 0;
+    std::vector<IoOperation> batch;     // full blocks submitted together at the end of a Write
+    std::vector<std::shared_ptr<IoTicket>> tickets;     // submitted writes that may still be running
+    size_t maxTickets = 16;     // batches in flight before Write waits for the oldest, which bounds the copied blocks held in memory
+    std::ostream stream;
+    bool isFailed = false;
+    bool isFinished = false;
+    std::chrono::steady_clock::time_point openTime;
+    double waitSeconds = 0.0;   // time spent blocked on the writes
+
+    void QueueBlock();
+    void SubmitBatch();
+    void WaitForTicket();
+    std::streamsize xsputn(const char* data, std::streamsize size) override;
+    int_type overflow(int_type character) override;
+public:
+    // a writer starting at offset 0 replaces the file, one starting further in keeps the bytes before it (e.g. appending to a journal)
+    // a replaced file is only swapped in by Finish, so a crash never leaves half a map and whatever still maps the old file keeps reading the old bytes
+    explicit FileWriter(const std::string& filename, std::uint64_t offset = 0);
+    ~FileWriter() { Finish(); }
+    FileWriter(const FileWriter&) = delete;
+    FileWriter& operator=(const FileWriter&) = delete;
+
+    bool IsOpen() const { return file != AsyncIO::InvalidFile; }
+    void Write(const void* data, size_t size);  // copied into blocks
+    void Write(std::shared_ptr<const std::vector<char>> data);  // a finished buffer is written from where it is, without a copy
+    void Skip(size_t size);     // leaves a gap, e.g. for a header that is only known at the end
+    void WriteAt(std::uint64_t offset, const void* data, size_t size);  // fills a gap left by Skip, copied and submitted on its own
+    std::ostream& GetStream() { return stream; }
+    std::uint64_t GetPosition() const { return position; }
+    bool Finish();  // writes the rest, waits for every write, closes the file and swaps it in, returns whether all of it reached the file
+};
+#endif
@@ -0,0 +1,94 @@
+#include "framescheduler.h"
+#include <algorithm>
+
+FrameScheduler::TaskId FrameScheduler::Start(const std::string& name, Step step, std::function<void()> onCancelled) {
+    std::shared_ptr<Task> task = std::make_shared<Task>();
+    task->id = ++taskIdCount;
+    task->name = name;
+    task->step = std::move(step);
+    task->onCancelled = std::move(onCancelled);
+    tasks.push_back(task);
+    return task->id;
+}
+
+FrameScheduler::TaskId FrameScheduler::StartLoop(const std::string& name, size_t count, std::function<void(size_t)> body, std::function<void()> onDone, std::function<void()> onCancelled) {
+    // the loop position lives in the step itself, which the task keeps from one frame to the next
+    return Start(name, [count, body, onDone, next = size_t(0)](FrameBudget& budget) mutable {
+        while (next < count) {
+            body(next++);
+            if (budget.IsExpired()) break;  // checked after each call, so every frame gets at least one done
+        }
+        budget.SetProgress(count > 0 ? static_cast<float>(next) / count : 1.f);
+        if (next < count) return false;
+        if (onDone) onDone();
+        return true;
+    }, std::move(onCancelled));
+}
+
+bool FrameScheduler::RunStep(const std::shared_ptr<Task>& task, std::chrono::steady_clock::time_point deadline) {
+    // the caller holds its own reference, so a step that cancels its own task still returns into a live task
+    FrameBudget budget(deadline);
+    budget.SetProgress(task->progress);
+    bool isDone = task->step(budget);
+    task->progress = budget.GetProgress();
+    if (isDone) Remove(task->id);
+    return isDone;
+}
+
+void FrameScheduler::Remove(TaskId id) {
+    tasks.erase(std::remove_if(tasks.begin(), tasks.end(), [id](const std::shared_ptr<Task>& task) { return task->id == id; }), tasks.end());
+}
+
+bool FrameScheduler::RunFor(std::chrono::microseconds budget) {
+    if (tasks.empty()) return false;
+    std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now() + budget;
+    // steps may start, finish or cancel tasks, so this frame's order is taken up front and every task is looked up again before its step
+    std::vector<std::shared_ptr<Task>> order;
+    size_t first = nextTask % tasks.size();
+    for (size_t i = 0; i < tasks.size(); ++i) { order.push_back(tasks[(first + i) % tasks.size()]); }
+    nextTask = first + 1;
+    for (size_t i = 0; i < order.size(); ++i) {
+        if (i > 0 && std::chrono::steady_clock::now() >= deadline) break;
+        if (!IsRunning(order[i]->id)) continue;
+        RunStep(order[i], deadline);
+    }
+    return true;
+}
+
+void FrameScheduler::Finish(TaskId id) {
+    // without a deadline a step only returns once it is done, the loop covers steps that return early anyway
+    while (IsRunning(id)) {
+        auto it = std::find_if(tasks.begin(), tasks.end(), [id](const std::shared_ptr<Task>& task) { return task->id == id; });
+        std::shared_ptr<Task> task = *it;
+        RunStep(task, std::chrono::steady_clock::time_point::max());
+    }
+}
+
+void FrameScheduler::FinishAll() {
+    while (!tasks.empty()) { Finish(tasks.front()->id); }
+}
+
+void FrameScheduler::Cancel(TaskId id) {
+    auto it = std::find_if(tasks.begin(), tasks.end(), [id](const std::shared_ptr<Task>& task) { return task->id == id; });
+    if (it == tasks.end()) return;
+    std::shared_ptr<Task> task = *it;
+    tasks.erase(it);
+    if (task->onCancelled) task->onCancelled();
+}
+
+void FrameScheduler::CancelNewest() {
+    if (!tasks.empty()) Cancel(tasks.back()->id);
+}
+
+bool FrameScheduler::IsRunning(TaskId id) const {
+    return std::any_of(tasks.begin(), tasks.end(), [id](const std::shared_ptr<Task>& task) { return task->id == id; });
+}
+
+std::string FrameScheduler::GetStatus() const {
+    std::string status;
+    for (const std::shared_ptr<Task>& task : tasks) {
+        if (!status.empty()) status += ", ";
+        status += task->name + "... " + std::to_string(static_cast<int>(task->progress * 100.f)) + "%";
+    }
+    return status;
+}
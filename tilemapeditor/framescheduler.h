@@ -0,0 +1,63 @@
+#ifndef FRAMESCHEDULER_H
+#define FRAMESCHEDULER_H
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+// time a task may still spend in the current frame, a step checks it between small pieces of work and returns once it ran out
+class FrameBudget {
+private:
+    std::chrono::steady_clock::time_point deadline;
+    float progress = 0.f;
+public:
+    explicit FrameBudget(std::chrono::steady_clock::time_point deadline) : deadline(deadline) {}
+    bool IsExpired() const { return std::chrono::steady_clock::now() >= deadline; }
+    void SetProgress(float value) { progress = value; }     // 0 to 1, shown by the ui while the task runs
+    float GetProgress() const { return progress; }
+};
+
+// runs long editor operations on the main thread a slice at a time, so they never hold up input or a frame for long
+// a task is a step function that keeps its position in whatever it captured and is called again every frame until it returns true,
+// the steps of every running task share the frame's budget, starting with a different task each frame so none of them starves
+// tasks edit the map like any other main thread code, unlike pool tasks they need no snapshot and no locking
+class FrameScheduler {
+public:
+    typedef std::uint64_t TaskId;
+    typedef std::function<bool(FrameBudget& budget)> Step;  // does the next slice of the work (at least one piece, even on an expired budget), returns true once the task is done
+private:
+    struct Task {
+        TaskId id;
+        std::string name;
+        Step step;
+        std::function<void()> onCancelled;  // lets the task undo or report what it left half done
+        float progress = 0.f;
+    };
+    std::vector<std::shared_ptr<Task>> tasks;   // in the order they were started
+    TaskId taskIdCount = 0;     // last id given to a task
+    size_t nextTask = 0;    // task the next frame starts with
+
+    bool RunStep(const std::shared_ptr<Task>& task, std::chrono::steady_clock::time_point deadline);
+    void Remove(TaskId id);
+public:
+    FrameScheduler() = default;
+    FrameScheduler(const FrameScheduler&) = delete;
+    FrameScheduler& operator=(const FrameScheduler&) = delete;
+
+    TaskId Start(const std::string& name, Step step, std::function<void()> onCancelled = nullptr);
+    // calls body(i) for every i in [0, count), as many as fit in each frame, then onDone
+    TaskId StartLoop(const std::string& name, size_t count, std::function<void(size_t)> body, std::function<void()> onDone = nullptr, std::function<void()> onCancelled = nullptr);
+    bool RunFor(std::chrono::microseconds budget);  // called once per frame by the editor, at least one step runs even when the budget is tiny, returns whether any did
+    void Finish(TaskId id);     // runs the rest of the task right now, for callers that need its result before going on, never from the task's own step
+    void FinishAll();
+    void Cancel(TaskId id);     // the task is dropped without another step, its onCancelled runs
+    void CancelNewest();
+    bool IsRunning(TaskId id) const;
+    bool IsBusy() const { return !tasks.empty(); }
+    std::string GetStatus() const;  // name and progress of every running task, empty when idle
+};
+#endif
@@ -0,0 +1,308 @@
+#include "jsonreader.h"
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+
+void JsonReader::SkipWhitespace() {
+    // pretty printed files are mostly indentation, so runs of spaces are skipped eight bytes at a time
+    const std::uint64_t spaces = 0x2020202020202020ull;
+    while (position < size) {
+        char c = data[position];
+        if (c == ' ') {
+            std::uint64_t block;
+            while (size - position >= 8 && (std::memcpy(&block, data + position, 8), block == spaces)) { position += 8; }
+            while (position < size && data[position] == ' ') { ++position; }
+        }
+        else if (c == '\n' || c == '\r' || c == '\t') {
+            ++position;
+        }
+        else {
+            return;
+        }
+    }
+}
+
+JsonReader::Token JsonReader::Fail(const char* message) {
+    if (!failed) {
+        failed = true;
+        error = std::string(message) + " at byte " + std::to_string(offset + position);
+    }
+    return Token::Error;
+}
+
+JsonReader::Token JsonReader::Next() {
+    if (failed) return Token::Error;
+    SkipWhitespace();
+    if (hasKey) {
+        hasKey = false;
+        return ReadValue();
+    }
+    if (scopes.empty()) {
+        if (!hasRoot) {
+            hasRoot = true;
+            return ReadValue();
+        }
+        return position == size ? Token::End : Fail("unexpected data after the document");
+    }
+    bool isObject = scopes.back().isObject;
+    char c = Peek();
+    if (c == (isObject ? '}' : ']')) {
+        ++position;
+        scopes.pop_back();
+        return isObject ? Token::EndObject : Token::EndArray;
+    }
+    if (!scopes.back().isEmpty) {
+        if (c != ',') return Fail(isObject ? "expected ',' or '}'" : "expected ',' or ']'");
+        ++position;
+        SkipWhitespace();
+    }
+    scopes.back().isEmpty = false;
+    if (!isObject) return ReadValue();
+    if (Peek() != '"' || !ReadString()) return Fail("expected a key");
+    SkipWhitespace();
+    if (Peek() != ':') return Fail("expected ':'");
+    ++position;
+    hasKey = true;
+    return Token::Key;
+}
+
+JsonReader::Token JsonReader::ReadValue() {
+    SkipWhitespace();
+    switch (Peek()) {
+    case '{':
+        ++position;
+        scopes.push_back({ true, true });
+        return Token::BeginObject;
+    case '[':
+        ++position;
+        scopes.push_back({ false, true });
+        return Token::BeginArray;
+    case '"':
+        return ReadString() ? Token::String : Token::Error;
+    case 't':
+        return ReadLiteral("true", 4) ? Token::True : Token::Error;
+    case 'f':
+        return ReadLiteral("false", 5) ? Token::False : Token::Error;
+    case 'n':
+        return ReadLiteral("null", 4) ? Token::Null : Token::Error;
+    case '\0':
+        if (position >= size) return Fail("unexpected end of data");
+        return Fail("unexpected character");
+    default:
+        return ReadNumber() ? Token::Number : Token::Error;
+    }
+}
+
+bool JsonReader::ReadLiteral(const char* literal, size_t length) {
+    if (size - position < length || std::memcmp(data + position, literal, length) != 0) {
+        Fail("invalid literal");
+        return false;
+    }
+    position += length;
+    return true;
+}
+
+static void AppendUtf8(std::string& out, unsigned long codePoint) {
+    if (codePoint < 0x80) {
+        out.push_back(static_cast<char>(codePoint));
+    }
+    else if (codePoint < 0x800) {
+        out.push_back(static_cast<char>(0xC0 | (codePoint >> 6)));
+        out.push_back(static_cast<char>(0x80 | (codePoint & 0x3F)));
+    }
+    else if (codePoint < 0x10000) {
+        out.push_back(static_cast<char>(0xE0 | (codePoint >> 12)));
+        out.push_back(static_cast<char>(0x80 | ((codePoint >> 6) & 0x3F)));
+        out.push_back(static_cast<char>(0x80 | (codePoint & 0x3F)));
+    }
+    else {
+        out.push_back(static_cast<char>(0xF0 | (codePoint >> 18)));
+        out.push_back(static_cast<char>(0x80 | ((codePoint >> 12) & 0x3F)));
+        out.push_back(static_cast<char>(0x80 | ((codePoint >> 6) & 0x3F)));
+        out.push_back(static_cast<char>(0x80 | (codePoint & 0x3F)));
+    }
+}
+
+bool JsonReader::ReadString() {
+    ++position; // opening quote
+    text.clear();
+    for (;;) {
+        // copy the plain run up to the next quote or escape in one go
+        size_t start = position;
+        while (position < size && data[position] != '"' && data[position] != '\\' && static_cast<unsigned char>(data[position]) >= 0x20) { ++position; }
+        text.append(data + start, position - start);
+        if (position >= size) {
+            Fail("unterminated string");
+            return false;
+        }
+        char c = data[position++];
+        if (c == '"') return true;
+        if (c != '\\') {
+            --position;
+            Fail("control character in string");
+            return false;
+        }
+        char escape = Peek();
+        ++position;
+        switch (escape) {
+        case '"': text.push_back('"'); break;
+        case '\\': text.push_back('\\'); break;
+        case '/': text.push_back('/'); break;
+        case 'b': text.push_back('\b'); break;
+        case 'f': text.push_back('\f'); break;
+        case 'n': text.push_back('\n'); break;
+        case 'r': text.push_back('\r'); break;
+        case 't': text.push_back('\t'); break;
+        case 'u': {
+            if (size - position < 4) {
+                Fail("invalid unicode escape");
+                return false;
+            }
+            char digits[5] = { data[position], data[position + 1], data[position + 2], data[position + 3], '\0' };
+            char* end = nullptr;
+            unsigned long codePoint = std::strtoul(digits, &end, 16);
+            if (end != digits + 4) {
+                Fail("invalid unicode escape");
+                return false;
+            }
+            position += 4;
+            // a high surrogate followed by an escaped low surrogate forms one code point
+            if (codePoint >= 0xD800 && codePoint < 0xDC00 && size - position >= 6 && data[position] == '\\' && data[position + 1] == 'u') {
+                char low[5] = { data[position + 2], data[position + 3], data[position + 4], data[position + 5], '\0' };
+                unsigned long lowPoint = std::strtoul(low, &end, 16);
+                if (end == low + 4 && lowPoint >= 0xDC00 && lowPoint < 0xE000) {
+                    codePoint = 0x10000 + ((codePoint - 0xD800) << 10) + (lowPoint - 0xDC00);
+                    position += 6;
+                }
+            }
+            AppendUtf8(text, codePoint);
+            break;
+        }
+        default:
+            Fail("invalid escape");
+            return false;
+        }
+    }
+}
+
+bool JsonReader::ReadNumber() {
+    size_t start = position;
+    bool isNegative = Peek() == '-';
+    if (isNegative) ++position;
+    if (Peek() < '0' || Peek() > '9') {
+        Fail("unexpected character");
+        return false;
+    }
+    // the digits are accumulated while validating, which covers every integer and short decimal (like positions) without strtod
+    unsigned long long mantissa = 0;
+    int digits = 0;
+    int fractionDigits = 0;
+    if (Peek() == '0') {
+        ++position;
+    }
+    else {
+        while (Peek() >= '0' && Peek() <= '9') {
+            if (digits < 19) mantissa = mantissa * 10 + static_cast<unsigned>(data[position] - '0');
+            ++digits;
+            ++position;
+        }
+    }
+    if (Peek() == '.') {
+        ++position;
+        if (Peek() < '0' || Peek() > '9') {
+            Fail("invalid number");
+            return false;
+        }
+        while (Peek() >= '0' && Peek() <= '9') {
+            if (digits < 19) {
+                mantissa = mantissa * 10 + static_cast<unsigned>(data[position] - '0');
+                ++fractionDigits;
+            }
+            if (mantissa != 0) ++digits; // leading zeros of the fraction don't count towards the precision
+            ++position;
+        }
+    }
+    bool hasExponent = Peek() == 'e' || Peek() == 'E';
+    if (hasExponent) {
+        ++position;
+        if (Peek() == '+' || Peek() == '-') ++position;
+        if (Peek() < '0' || Peek() > '9') {
+            Fail("invalid number");
+            return false;
+        }
+        while (Peek() >= '0' && Peek() <= '9') { ++position; }
+    }
+    // exact when the mantissa fits in a double's 53 bits and the power of ten is exactly representable, a single division then rounds correctly
+    static const double powersOfTen[] = { 1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11, 1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22 };
+    if (!hasExponent && digits <= 15 && fractionDigits <= 22) {
+        number = static_cast<double>(mantissa) / powersOfTen[fractionDigits];
+        if (isNegative) number = -number;
+        return true;
+    }
+    // the data may not be null terminated (a mapped file), so strtod gets its own copy of the number
+    std::string numberText(data + start, position - start);
+    number = std::strtod(numberText.c_str(), nullptr);
+    return true;
+}
+
+bool JsonReader::SkipValue(Token first) {
+    if (first == Token::Error || first == Token::End) return false;
+    if (first != Token::BeginObject && first != Token::BeginArray) return true;
+    // skipped containers are only scanned for their closing bracket, strings are stepped over so brackets inside them don't count
+    int depth = 1;
+    while (position < size) {
+        char c = data[position++];
+        if (c == '"') {
+            while (position < size && data[position] != '"') { position += data[position] == '\\' ? 2 : 1; }
+            ++position;
+        }
+        else if (c == '{' || c == '[') {
+            ++depth;
+        }
+        else if ((c == '}' || c == ']') && --depth == 0) {
+            scopes.pop_back();
+            return true;
+        }
+    }
+    Fail("unexpected end of data");
+    return false;
+}
+
+bool JsonReader::SkipElements(size_t count) {
+    if (failed || scopes.empty() || scopes.back().isObject) return false;
+    // each value is only scanned for the separator after it, the same way SkipValue steps over containers
+    for (size_t skipped = 0; skipped < count; ++skipped) {
+        SkipWhitespace();
+        if (Peek() == ']') return true;
+        if (!scopes.back().isEmpty) {
+            if (Peek() != ',') {
+                Fail("expected ',' or ']'");
+                return false;
+            }
+            ++position;
+        }
+        scopes.back().isEmpty = false;
+        int depth = 0;
+        for (; position < size; ++position) {
+            char c = data[position];
+            if (c == '"') {
+                for (++position; position < size && data[position] != '"'; ) { position += data[position] == '\\' ? 2 : 1; }
+            }
+            else if (c == '{' || c == '[') {
+                ++depth;
+            }
+            else if (c == '}' || c == ']') {
+                if (depth == 0) break;
+                --depth;
+            }
+            else if (c == ',' && depth == 0) {
+                break;
+            }
+        }
+        if (position >= size) {
+            Fail("unexpected end of data");
+            return false;
+        }
+    }
+    return true;
+}
@@ -0,0 +1,50 @@
+#ifndef JSONREADER_H
+#define JSONREADER_H
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+// pull tokenizer for json held in memory (e.g. a mapped file), the caller asks for one token at a time and nothing is stored
+// commas and colons are checked and consumed internally, so the caller only sees values, keys and container boundaries
+class JsonReader {
+public:
+    enum class Token { BeginObject, EndObject, BeginArray, EndArray, Key, String, Number, True, False, Null, End, Error };
+private:
+    struct Scope {
+        bool isObject;
+        bool isEmpty;
+    };
+    const char* data;
+    size_t size;
+    size_t offset;  // where data starts within the whole document, added to the byte positions of errors
+    size_t position = 0;
+    std::vector<Scope> scopes;
+    bool hasRoot = false;
+    bool hasKey = false;    // a key and its colon were read, the next token is its value
+    bool failed = false;
+    std::string text;   // last key or string value, reused so reading keys doesn't allocate
+    double number = 0;
+    std::string error;
+
+    char Peek() const { return position < size ? data[position] : '\0'; }
+    void SkipWhitespace();
+    Token ReadValue();
+    bool ReadString();
+    bool ReadNumber();
+    bool ReadLiteral(const char* literal, size_t length);
+    Token Fail(const char* message);
+public:
+    JsonReader(const char* data, size_t size, size_t offset = 0) : data(data), size(size), offset(offset) {}
+    Token Next();
+    bool SkipValue(Token first);    // skip the rest of a value whose first token was already read, skipped containers aren't validated
+    bool SkipElements(size_t count);    // skip up to count values of the current array without parsing them, stops early at its end
+    const std::string& GetText() const { return text; }
+    double GetNumber() const { return number; }
+    size_t GetPosition() const { return position; }
+    size_t GetSize() const { return size; }
+    size_t GetOffset() const { return offset; }
+    const char* GetData() const { return data; }
+    const std::string& GetError() const { return error; }
+};
+#endif
\ No newline at end of file
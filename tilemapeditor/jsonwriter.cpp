@@ -0,0 +1,158 @@
+#include "jsonwriter.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+JsonWriter::JsonWriter(std::ostream& out, bool isPretty, int indent) : out(out), isPretty(isPretty), indent(indent) {
+    buffer.reserve(flushSize + 256);
+}
+
+void JsonWriter::Raw(const char* text, size_t length) {
+    buffer.append(text, length);
+    if (buffer.size() >= flushSize) { Flush(); }
+}
+
+void JsonWriter::NewLine(size_t depth) {
+    if (!isPretty) return;
+    buffer.push_back('\n');
+    buffer.append(depth * indent, ' ');
+}
+
+void JsonWriter::BeginValue() {
+    if (hasKey) {   // the key already wrote the separator
+        hasKey = false;
+        return;
+    }
+    if (scopes.empty()) return;
+    Scope& scope = scopes.back();
+    if (scope.count > 0) { buffer.push_back(','); }
+    if (scope.count++ % scope.itemsPerLine == 0) NewLine(scopes.size());
+}
+
+void JsonWriter::End(char close) {
+    // empty containers stay on one line, like "[]"
+    if (scopes.back().count > 0) { NewLine(scopes.size() - 1); }
+    scopes.pop_back();
+    Raw(&close, 1);
+}
+
+void JsonWriter::BeginObject() {
+    BeginValue();
+    Raw("{", 1);
+    scopes.push_back({ true, 1 });
+}
+
+void JsonWriter::BeginArray(int itemsPerLine) {
+    BeginValue();
+    Raw("[", 1);
+    scopes.push_back({ false, std::max(1, itemsPerLine) });
+}
+
+void JsonWriter::Key(const char* name) {
+    BeginValue();
+    WriteString(name);
+    if (isPretty) Raw(": ", 2);
+    else Raw(":", 1);
+    hasKey = true;
+}
+
+void JsonWriter::Int(long long value) {
+    BeginValue();
+    char text[24];
+    int length = std::snprintf(text, sizeof(text), "%lld", value);
+    Raw(text, length);
+}
+
+void JsonWriter::Float(double value) {
+    if (!std::isfinite(value)) {    // json has no infinity or nan, nlohmann writes null for them as well
+        Null();
+        return;
+    }
+    BeginValue();
+    // shortest text that reads back as the same double, the same digits nlohmann prints
+    char text[32];
+    int length = 0;
+    for (int precision = 1; precision <= 17; ++precision) {
+        length = std::snprintf(text, sizeof(text), "%.*g", precision, value);
+        if (std::strtod(text, nullptr) == value) break;
+    }
+    Raw(text, length);
+    if (!std::strpbrk(text, ".eE")) Raw(".0", 2);  // keep integral floats recognizable as floats
+}
+
+void JsonWriter::Bool(bool value) {
+    BeginValue();
+    if (value) Raw("true", 4);
+    else Raw("false", 5);
+}
+
+void JsonWriter::Null() {
+    BeginValue();
+    Raw("null", 4);
+}
+
+void JsonWriter::String(const std::string& value) {
+    BeginValue();
+    WriteString(value);
+}
+
+JsonWriter::ArrayLayout JsonWriter::GetArrayLayout() const {
+    return { scopes.size(), scopes.empty() ? 1 : scopes.back().itemsPerLine, isPretty, indent };
+}
+
+void JsonWriter::AppendInts(std::string& text, const ArrayLayout& layout, size_t firstIndex, const std::uint32_t* values, size_t count) {
+    // same separators and line breaks as BeginValue, with the item index standing in for the scope's count
+    for (size_t i = 0; i < count; ++i) {
+        size_t index = firstIndex + i;
+        if (index > 0) text.push_back(',');
+        if (layout.isPretty && index % layout.itemsPerLine == 0) {
+            text.push_back('\n');
+            text.append(layout.depth * layout.indent, ' ');
+        }
+        char digits[10];
+        int length = 0;
+        std::uint32_t value = values[i];
+        do {
+            digits[length++] = static_cast<char>('0' + value % 10);
+            value /= 10;
+        } while (value != 0);
+        while (length > 0) { text.push_back(digits[--length]); }
+    }
+}
+
+void JsonWriter::Fragment(const std::string& text, size_t count) {
+    if (count == 0) return;
+    Raw(text.data(), text.size());
+    scopes.back().count += static_cast<int>(count);
+}
+
+void JsonWriter::WriteString(const std::string& value) {
+    buffer.push_back('"');
+    for (char c : value) {
+        switch (c) {
+        case '"': buffer.append("\\\""); break;
+        case '\\': buffer.append("\\\\"); break;
+        case '\n': buffer.append("\\n"); break;
+        case '\r': buffer.append("\\r"); break;
+        case '\t': buffer.append("\\t"); break;
+        default:
+            if (static_cast<unsigned char>(c) < 0x20) {
+                char escaped[8];
+                std::snprintf(escaped, sizeof(escaped), "\\u%04x", static_cast<unsigned char>(c));
+                buffer.append(escaped);
+            }
+            else {
+                buffer.push_back(c);
+            }
+        }
+    }
+    Raw("\"", 1);
+}
+
+void JsonWriter::Flush() {
+    if (buffer.empty()) return;
+    out.write(buffer.data(), buffer.size());
+    buffer.clear();
+}
\ No newline at end of file
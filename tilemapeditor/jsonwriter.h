@@ -0,0 +1,58 @@
+#ifndef JSONWRITER_H
+#define JSONWRITER_H
+
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+
+// writes json straight to a stream while it is produced, so no document tree is ever built
+// the output matches nlohmann::json::dump (dump(4) when pretty printing) as long as keys are written in sorted order
+class JsonWriter {
+private:
+    struct Scope {
+        bool isObject;
+        int itemsPerLine;   // when pretty printing, arrays with a value here put that many items on each line (e.g. a row of tiles)
+        int count = 0;  // values written so far, decides whether a separator is needed
+    };
+    std::ostream& out;
+    std::string buffer; // pending output, handed to the stream in blocks of flushSize bytes
+    std::vector<Scope> scopes;
+    bool isPretty;
+    int indent;
+    bool hasKey = false;    // a key was just written, so the next value belongs to it
+    static const size_t flushSize = 1 << 16;
+
+    void BeginValue();
+    void NewLine(size_t depth);
+    void Raw(const char* text, size_t length);
+    void WriteString(const std::string& value);
+    void End(char close);
+public:
+    // long integer arrays can be formatted in bands on several threads, AppendInts formats a band exactly the way Int would write
+    // those items and Fragment appends the formatted bands to the current array in order
+    struct ArrayLayout {
+        size_t depth;   // nesting depth of the array's items
+        int itemsPerLine;
+        bool isPretty;
+        int indent;
+    };
+
+    JsonWriter(std::ostream& out, bool isPretty = true, int indent = 4);
+    ~JsonWriter() { Flush(); }
+    void BeginObject();
+    void EndObject() { End('}'); }
+    void BeginArray(int itemsPerLine = 1);
+    void EndArray() { End(']'); }
+    void Key(const char* name);
+    void Int(long long value);
+    void Float(double value);
+    void Bool(bool value);
+    void Null();
+    void String(const std::string& value);
+    ArrayLayout GetArrayLayout() const;
+    static void AppendInts(std::string& text, const ArrayLayout& layout, size_t firstIndex, const std::uint32_t* values, size_t count);
+    void Fragment(const std::string& text, size_t count);
+    void Flush();
+};
+#endif
\ No newline at end of file
@@ -1,47 +1,354 @@
 #include "layer.h"
 #include "editor.h"
 #include "tileatlas.h"
+#include "mapformat.h"
+#include "tilecodec.h"
+#include "mappedfile.h"
+#include "jsonwriter.h"
+#include "jsonreader.h"
+#include "threadpool.h"
+#include "asyncio.h"
+#include "filewriter.h"
+#include <cmath>
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
 
 TileMap::TileMap(Editor& editor, TileAtlas& tileAtlas) : editor(editor), tileAtlas(tileAtlas) {}
 
+TileMap::~TileMap() {
+    // a load that is still running only reads its own state, it is stopped so the task can be waited for
+    if (activeLoad) {
+        activeLoad->isCancelled = true;
+        loadTasks.Wait();
+    }
+}
+
 void TileMap::Initialize(int width, int height) {
 
 }
 
-void TileMap::AddLayer(int width, int height) {
+void TileMap::AddLayer(int width, int height, bool isInfinite) {
+    if (activeLoad) return; // the layers on screen still belong to the map being loaded
     // create a new TileLayer instance and set passed in properties
     TileLayer newLayer;
     newLayer.width = width;
     newLayer.height = height;
+    newLayer.isInfinite = isInfinite;   // an infinite layer's width and height are only its initial size, painting outside of it is allowed
     newLayer.isVisible = true;
     newLayer.opacity = 1.0f;
     newLayer.index = layers.size();
-    newLayer.layer.resize(height, std::vector<Tile>(width));
-    layers.push_back(newLayer); // push the new layer back into the layers vector
+    newLayer.chunkSize = defaultChunkSize;  // no tiles are allocated up front, chunks are created on their first write
+    newLayer.id = ++layerIdCount;
+    layers.push_back(std::move(newLayer)); // push the new layer back into the layers vector
     activeLayerIndex = layers.size() - 1;   // set this new layer as the current/active layer
+    layoutRevision = ++revision;
+    editor.RequestRedraw();
 }
 
-void TileMap::AddTile(const sf::Texture& texture, const sf::IntRect& rect, int index, int x, int y) {
-    if (activeLayerIndex < 0 || activeLayerIndex >= layers.size()) return;
+void TileMap::AddTile(TileCell cell, int x, int y) {
+    if (activeLayerIndex < 0 || activeLayerIndex >= layers.size() || activeLoad) return;
 
     TileLayer& currentLayer = layers[activeLayerIndex];
 
-    if (x >= 0 && x < currentLayer.width && y >= 0 && y < currentLayer.height) {
-        Tile& tile = currentLayer.layer[y][x];
-        tile.index = index;
-        tile.sprite.setTexture(texture);
-        tile.sprite.setTextureRect(rect);
-        tile.sprite.setScale(layerScaleFactor, layerScaleFactor); // apply scale factor to the layer tiles
-        tile.sprite.setPosition(x * layerTileSize, y * layerTileSize); // apply position based on the tile size
+    if (currentLayer.Contains(x, y)) {
+        if (currentLayer.SetCell(x, y, cell)) {
+            currentLayer.StampChunk(currentLayer.GetChunkKey(x, y), ++revision);
+            editor.RequestRedraw(); // the stamp tells the renderer to rebuild only this chunk's quads
+        }
     }
 }
 
 void TileMap::RemoveTile(int x, int y) {
+    // removing a tile writes an empty cell, which frees the chunk once its last tile is gone
+    AddTile(EmptyCell, x, y);
+}
+
+TileCell TileMap::TileLayer::GetCell(int x, int y) const {
+    auto it = chunks.find(GetChunkKey(x, y));
+    if (it == chunks.end()) return EmptyCell;   // cells of chunks that were never written are empty
+    int localX = x - FloorDiv(x, chunkSize) * chunkSize;
+    int localY = y - FloorDiv(y, chunkSize) * chunkSize;
+    return it->second.GetCells()[localY * chunkSize + localX];
+}
+
+bool TileMap::TileLayer::SetCell(int x, int y, TileCell cell) {
+    std::int64_t key = GetChunkKey(x, y);
+    auto it = chunks.find(key);
+    if (it == chunks.end()) {
+        if (cell == EmptyCell) return false;    // erasing inside a missing chunk changes nothing
+        // lazily create the chunk on its first write
+        TileChunk chunk;
+        chunk.cells = AllocateCells(static_cast<size_t>(chunkSize) * chunkSize);
+        it = chunks.emplace(key, std::move(chunk)).first;
+    }
+    int localX = x - FloorDiv(x, chunkSize) * chunkSize;
+    int localY = y - FloorDiv(y, chunkSize) * chunkSize;
+    size_t offset = static_cast<size_t>(localY) * chunkSize + localX;
+    TileCell current = it->second.GetCells()[offset];
+    if (current == cell) return false;
+    // keep the tile count in sync so empty chunks can be reclaimed
+    if (current == EmptyCell) {
+        ++it->second.tileCount;
+        IncludeInBounds(sf::IntRect(x, y, 1, 1));  // grow the bounds to include the new tile
+    }
+    else if (cell == EmptyCell) {
+        --it->second.tileCount;
+        // erasing a tile on the edge of the bounds may shrink them, which is worked out lazily in GetTileBounds
+        if (x == tileBounds.left || y == tileBounds.top || x == tileBounds.left + tileBounds.width - 1 || y == tileBounds.top + tileBounds.height - 1) {
+            isBoundsStale = true;
+        }
+    }
+    it->second.GetWritableCells(static_cast<size_t>(chunkSize) * chunkSize)[offset] = cell;
+    if (it->second.tileCount == 0) { chunks.erase(it); }
+    return true;
+}
+
+bool TileMap::TileLayer::WriteArea(const sf::IntRect& requested, const TileCell* cells, int stride, std::uint64_t revision) {
+    sf::IntRect area = requested;
+    if (!isInfinite && !sf::IntRect(0, 0, width, height).intersects(requested, area)) return false;
+    if (area.width <= 0 || area.height <= 0) return false;
+    bool isFill = stride == 0;
+    TileCell fill = cells[0];
+    size_t cellCount = static_cast<size_t>(chunkSize) * chunkSize;
+    // source row of a stamp for the cells of layer row y starting at column x
+    auto sourceRow = [&](int x, int y) { return cells + static_cast<size_t>(y - requested.top) * stride + (x - requested.left); };
+    bool isChanged = false;
+    bool isErased = false;
+    int writtenLeft = area.left + area.width, writtenTop = area.top + area.height, writtenRight = area.left - 1, writtenBottom = area.top - 1;
+    int firstChunkX = FloorDiv(area.left, chunkSize), lastChunkX = FloorDiv(area.left + area.width - 1, chunkSize);
+    int firstChunkY = FloorDiv(area.top, chunkSize), lastChunkY = FloorDiv(area.top + area.height - 1, chunkSize);
+    for (int chunkY = firstChunkY; chunkY <= lastChunkY; ++chunkY) {
+        for (int chunkX = firstChunkX; chunkX <= lastChunkX; ++chunkX) {
+            std::int64_t key = MakeChunkKey(chunkX, chunkY);
+            int originX = chunkX * chunkSize, originY = chunkY * chunkSize;
+            int startX = std::max(area.left, originX), endX = std::min(area.left + area.width, originX + chunkSize);
+            int startY = std::max(area.top, originY), endY = std::min(area.top + area.height, originY + chunkSize);
+            int count = endX - startX;
+            auto it = chunks.find(key);
+            if (it == chunks.end()) {
+                // erasing inside a missing chunk changes nothing, neither does the empty part of a stamp
+                bool hasTiles = isFill && fill != EmptyCell;
+                for (int y = startY; y < endY && !isFill && !hasTiles; ++y) {
+                    const TileCell* source = sourceRow(startX, y);
+                    hasTiles = std::any_of(source, source + count, [](TileCell cell) { return cell != EmptyCell; });
+                }
+                if (!hasTiles) continue;
+            }
+            else {
+                // a chunk the write leaves as it is keeps its cells, so a shared chunk isn't copied and the renderer keeps its mesh
+                const TileCell* current = it->second.GetCells();
+                bool isDifferent = false;
+                for (int y = startY; y < endY && !isDifferent; ++y) {
+                    const TileCell* row = current + static_cast<size_t>(y - originY) * chunkSize + (startX - originX);
+                    if (isFill) { isDifferent = std::any_of(row, row + count, [fill](TileCell cell) { return cell != fill; }); }
+                    else {
+                        const TileCell* source = sourceRow(startX, y);
+                        for (int i = 0; i < count && !isDifferent; ++i) { isDifferent = source[i] != EmptyCell && source[i] != row[i]; }
+                    }
+                }
+                if (!isDifferent) continue;
+            }
+            bool isCovered = isFill && count == chunkSize && endY - startY == chunkSize;
+            if (isCovered && fill == EmptyCell) {
+                // the whole chunk is erased
+                chunks.erase(it);
+                isErased = true;
+                StampChunk(key, revision);
+                isChanged = true;
+                continue;
+            }
+            if (it == chunks.end()) {
+                TileChunk chunk;
+                chunk.cells = AllocateCells(cellCount);
+                it = chunks.emplace(key, std::move(chunk)).first;
+            }
+            TileChunk& chunk = it->second;
+            if (isCovered) {
+                // every cell is replaced, so a shared chunk gets new memory instead of a copy that is overwritten straight away
+                if (chunk.isReadOnly) {
+                    chunk.cells = AllocateCells(cellCount);
+                    chunk.isReadOnly = false;
+                }
+                std::fill(chunk.cells.get(), chunk.cells.get() + cellCount, fill);
+                chunk.tileCount = static_cast<int>(cellCount);
+            }
+            else {
+                TileCell* target = chunk.GetWritableCells(cellCount);
+                for (int y = startY; y < endY; ++y) {
+                    TileCell* row = target + static_cast<size_t>(y - originY) * chunkSize + (startX - originX);
+                    if (isFill) {
+                        int empty = static_cast<int>(std::count(row, row + count, EmptyCell));
+                        if (fill == EmptyCell) {
+                            chunk.tileCount -= count - empty;
+                            isErased = isErased || empty < count;
+                        }
+                        else { chunk.tileCount += empty; }
+                        std::fill(row, row + count, fill);
+                        continue;
+                    }
+                    const TileCell* source = sourceRow(startX, y);
+                    for (int i = 0; i < count; ++i) {
+                        if (source[i] == EmptyCell) continue;
+                        if (row[i] == EmptyCell) ++chunk.tileCount;
+                        row[i] = source[i];
+                        writtenLeft = std::min(writtenLeft, startX + i);
+                        writtenRight = std::max(writtenRight, startX + i);
+                        writtenTop = std::min(writtenTop, y);
+                        writtenBottom = std::max(writtenBottom, y);
+                    }
+                }
+            }
+            if (chunk.tileCount == 0) { chunks.erase(it); }
+            StampChunk(key, revision);
+            isChanged = true;
+        }
+    }
+    if (!isChanged) return false;
+    // the bounds are updated once for the whole write instead of per cell
+    if (isFill && fill != EmptyCell) { IncludeInBounds(area); }
+    else if (writtenRight >= writtenLeft) { IncludeInBounds(sf::IntRect(writtenLeft, writtenTop, writtenRight - writtenLeft + 1, writtenBottom - writtenTop + 1)); }
+    // an erase reaching the edge of the bounds may shrink them, which is worked out lazily in GetTileBounds
+    if (isErased && (area.left <= tileBounds.left || area.top <= tileBounds.top ||
+        area.left + area.width >= tileBounds.left + tileBounds.width || area.top + area.height >= tileBounds.top + tileBounds.height)) {
+        isBoundsStale = true;
+    }
+    return true;
+}
+
+void TileMap::TileLayer::IncludeInBounds(const sf::IntRect& rect) {
+    if (tileBounds.width <= 0 || tileBounds.height <= 0) {
+        tileBounds = rect;
+        return;
+    }
+    int right = std::max(tileBounds.left + tileBounds.width, rect.left + rect.width);
+    int bottom = std::max(tileBounds.top + tileBounds.height, rect.top + rect.height);
+    tileBounds.left = std::min(tileBounds.left, rect.left);
+    tileBounds.top = std::min(tileBounds.top, rect.top);
+    tileBounds.width = right - tileBounds.left;
+    tileBounds.height = bottom - tileBounds.top;
+}
+
+std::int64_t TileMap::TileLayer::GetChunkKey(int x, int y) const {
+    return MakeChunkKey(FloorDiv(x, chunkSize), FloorDiv(y, chunkSize));
+}
+
+sf::IntRect TileMap::TileLayer::GetTileBounds() const {
+    if (!isBoundsStale) return tileBounds;
+    // recompute from the stored chunks only, so the cost depends on how much is painted rather than on the covered area
+    int left = 0, top = 0, right = 0, bottom = 0;
+    bool hasTiles = false;
+    for (const auto& entry : chunks) {
+        int startX = GetChunkKeyX(entry.first) * chunkSize;
+        int startY = GetChunkKeyY(entry.first) * chunkSize;
+        for (int localY = 0; localY < chunkSize; ++localY) {
+            for (int localX = 0; localX < chunkSize; ++localX) {
+                if (entry.second.GetCells()[localY * chunkSize + localX] == EmptyCell) continue;
+                int x = startX + localX;
+                int y = startY + localY;
+                if (!hasTiles) { left = right = x; top = bottom = y; hasTiles = true; }
+                left = std::min(left, x);
+                top = std::min(top, y);
+                right = std::max(right, x);
+                bottom = std::max(bottom, y);
+            }
+        }
+    }
+    tileBounds = hasTiles ? sf::IntRect(left, top, right - left + 1, bottom - top + 1) : sf::IntRect();
+    isBoundsStale = false;
+    return tileBounds;
+}
 
+void TileMap::TileLayer::InsertChunk(std::int64_t key, std::shared_ptr<TileCell> cells, int tileCount, bool isReadOnly) {
+    // bulk path for loading, a whole chunk is moved in instead of being written cell by cell
+    if (tileCount == 0) return;
+    TileChunk chunk;
+    chunk.cells = std::move(cells);
+    chunk.tileCount = tileCount;
+    chunk.isReadOnly = isReadOnly;
+    chunks[key] = std::move(chunk);
+    isBoundsStale = true;   // bounds are worked out on request instead of per inserted cell
+}
+
+void TileMap::TileLayer::CropToArea(const sf::IntRect& area) {
+    // chunks outside the area are dropped, chunks on its edge only keep the cells inside it
+    size_t cellCount = static_cast<size_t>(chunkSize) * chunkSize;
+    for (auto it = chunks.begin(); it != chunks.end();) {
+        sf::IntRect chunkRect(GetChunkKeyX(it->first) * chunkSize, GetChunkKeyY(it->first) * chunkSize, chunkSize, chunkSize);
+        sf::IntRect overlap;
+        bool isKept = area.intersects(chunkRect, overlap);
+        if (isKept && overlap != chunkRect) {
+            std::shared_ptr<TileCell> cells = AllocateCells(cellCount);
+            const TileCell* source = it->second.GetCells();
+            for (int y = overlap.top; y < overlap.top + overlap.height; ++y) {
+                size_t rowStart = static_cast<size_t>(y - chunkRect.top) * chunkSize + (overlap.left - chunkRect.left);
+                std::copy(source + rowStart, source + rowStart + overlap.width, cells.get() + rowStart);
+            }
+            it->second.cells = std::move(cells);
+            it->second.tileCount = static_cast<int>(cellCount - std::count(it->second.GetCells(), it->second.GetCells() + cellCount, EmptyCell));
+            it->second.isReadOnly = false;
+            isKept = it->second.tileCount > 0;
+        }
+        if (isKept) {
+            ++it;
+            continue;
+        }
+        it = chunks.erase(it);
+    }
+    isBoundsStale = true;
+}
+
+void TileMap::TileLayer::StampChunk(std::int64_t key, std::uint64_t revision) {
+    auto it = chunks.find(key);
+    if (it != chunks.end()) {
+        it->second.revision = revision;
+        if (!removedChunks.empty()) removedChunks.erase(key);   // the chunk was erased and painted again
+    }
+    else {
+        removedChunks[key] = revision;
+    }
+}
+
+std::vector<TileCell> TileMap::TileLayer::CopyArea(const sf::IntRect& area) const {
+    // row-major copy of a rect of cells, only the chunks overlapping it are visited
+    std::vector<TileCell> cells(static_cast<size_t>(std::max(area.width, 0)) * static_cast<size_t>(std::max(area.height, 0)), EmptyCell);
+    if (cells.empty()) return cells;
+    int firstChunkX = FloorDiv(area.left, chunkSize), lastChunkX = FloorDiv(area.left + area.width - 1, chunkSize);
+    int firstChunkY = FloorDiv(area.top, chunkSize), lastChunkY = FloorDiv(area.top + area.height - 1, chunkSize);
+    for (int chunkY = firstChunkY; chunkY <= lastChunkY; ++chunkY) {
+        for (int chunkX = firstChunkX; chunkX <= lastChunkX; ++chunkX) {
+            auto it = chunks.find(MakeChunkKey(chunkX, chunkY));
+            if (it == chunks.end()) continue;
+            const TileCell* chunkCells = it->second.GetCells();
+            int startX = std::max(area.left, chunkX * chunkSize), endX = std::min(area.left + area.width, (chunkX + 1) * chunkSize);
+            int startY = std::max(area.top, chunkY * chunkSize), endY = std::min(area.top + area.height, (chunkY + 1) * chunkSize);
+            for (int y = startY; y < endY; ++y) {
+                const TileCell* source = chunkCells + (y - chunkY * chunkSize) * chunkSize + (startX - chunkX * chunkSize);
+                std::copy(source, source + (endX - startX), cells.begin() + static_cast<size_t>(y - area.top) * area.width + (startX - area.left));
+            }
+        }
+    }
+    return cells;
+}
+
+TileCell* TileMap::TileChunk::GetWritableCells(size_t count) {
+    // copy on write, cells still pointing into the mapped file or shared with a save snapshot or render frame get their own memory before the first edit
+    if (isReadOnly) {
+        std::shared_ptr<TileCell> copy = AllocateCells(count);
+        std::copy(cells.get(), cells.get() + count, copy.get());
+        cells = std::move(copy);
+        isReadOnly = false;
+    }
+    return cells.get();
+}
+
+std::shared_ptr<TileCell> TileMap::AllocateCells(size_t count) {
+    return std::shared_ptr<TileCell>(new TileCell[count](), std::default_delete<TileCell[]>());
 }
 
 void TileMap::SetCurrentLayer(int index) {
     if (index >= 0 && index < layers.size()) {
+        if (activeLayerIndex != index) { editor.RequestRedraw(); }
         activeLayerIndex = index;
         std::cout << "Switched to layer: " << activeLayerIndex << "\n";
     }
@@ -54,76 +361,216 @@ void TileMap::HandleTilePlacement(const sf::Vector2f& mousePos) {
     const TileAtlas::SelectedTile& selectedTile = tileAtlas.GetSelectedTile();
     // if there is no texture selection in the selectedTile struct, exit early
     if (selectedTile.textureRects.empty()) return;
-    // convert mouse position to grid coordinates, accounting for zooming and panning
-    sf::Vector2f adjustedMousePos = (mousePos + editor.layerViewOffset) / layerScaleFactor;
-    // grid position of the placement
-    int gridX = static_cast<int>(adjustedMousePos.x / editor.baseTileSize);
-    int gridY = static_cast<int>(adjustedMousePos.y / editor.baseTileSize);
+    // the mouse position is already in world space (the layer view handles zooming and panning)
+    // grid position of the placement, floored so positions left of or above the origin map to negative cells on infinite layers
+    int gridX = static_cast<int>(std::floor(mousePos.x / editor.baseTileSize));
+    int gridY = static_cast<int>(std::floor(mousePos.y / editor.baseTileSize));
 
-    // iterate through all selected tiles
+    // the selection is turned into a stamp and written in one go, so a big selection is a single edit and a single redraw
+    int width = selectedTile.selectionBounds.width / editor.baseTileSize;
+    int height = selectedTile.selectionBounds.height / editor.baseTileSize;
+    std::vector<TileCell> stamp(static_cast<size_t>(width) * height, EmptyCell);
     for (const auto& rect : selectedTile.textureRects) {
         // calculate offset from the top-left corner of the selection
         int offsetX = (rect.left - selectedTile.selectionBounds.left) / editor.baseTileSize;
         int offsetY = (rect.top - selectedTile.selectionBounds.top) / editor.baseTileSize;
-        // calculate tile's grid position on the map
-        int targetX = gridX + offsetX;
-        int targetY = gridY + offsetY;
-        // determine tile index in the atlas
-        int tileIndex = (rect.top / editor.baseTileSize) *
-            (tileAtlas.GetTexture().getSize().x / editor.baseTileSize) +
-            (rect.left / editor.baseTileSize);
-        // add the tile to the map
-        AddTile(tileAtlas.GetTexture(), rect, tileIndex, targetX, targetY);
+        stamp[static_cast<size_t>(offsetY) * width + offsetX] = MakeTileCell(tileAtlas.GetTileIndex(rect));
     }
+    PlaceStamp(stamp, width, gridX, gridY);
 }
 
-void TileMap::DrawLayerGrid(sf::RenderTarget& target, int index) {
-    if (index < 0 || index >= layers.size()) {  // don't try to draw the layer grid if a layer grid has not been created via the ui buttons
-        std::cerr << "Invalid layer index for rendering: " << index << "\n";
+void TileMap::PlaceStamp(const std::vector<TileCell>& cells, int width, int x, int y) {
+    if (activeLayerIndex < 0 || activeLayerIndex >= layers.size() || activeLoad) return;
+    if (width <= 0 || cells.empty()) return;
+    int height = static_cast<int>(cells.size() / width);
+    if (layers[activeLayerIndex].WriteArea(sf::IntRect(x, y, width, height), cells.data(), width, revision + 1)) {
+        ++revision;
+        editor.RequestRedraw(); // the stamps tell the renderer to rebuild only the chunks that changed
+    }
+}
+
+void TileMap::FillRegion(const sf::IntRect& area, TileCell cell) {
+    if (activeLayerIndex < 0 || activeLayerIndex >= layers.size() || activeLoad) return;
+    TileLayer& layer = layers[activeLayerIndex];
+    sf::IntRect clipped = area;
+    if (!layer.isInfinite && !sf::IntRect(0, 0, layer.width, layer.height).intersects(area, clipped)) return;
+    if (clipped.width <= 0 || clipped.height <= 0) return;
+    if (static_cast<std::uint64_t>(clipped.width) * static_cast<std::uint64_t>(clipped.height) <= maxDirectFillCells) {
+        // the whole fill is one edit: one revision, one stamp per chunk it changed and one redraw
+        if (layer.WriteArea(clipped, &cell, 0, revision + 1)) {
+            ++revision;
+            editor.RequestRedraw();
+        }
         return;
     }
-    sf::Vector2f offset = editor.layerViewOffset;   // get the offset of the layer view that is updated when panning
-    const TileLayer& layer = layers[index]; // get the active TileLayer instance from the layers vector
-// iterates over the tiles of the active layer, each tiles position is calculated based on its coordinates in the grid (x * layerTileSize, y * layerTileSize)
-    for (int y = 0; y < layer.height; ++y) {
-        for (int x = 0; x < layer.width; ++x) {
-            sf::Vector2f tilePosition(static_cast<float>(x * layerTileSize), static_cast<float>(y * layerTileSize));
-            const Tile& tile = layer.layer[y][x];
-            if (tile.index >= 0) {
-                sf::Sprite tileSprite = tile.sprite;    // get the sprite from the Tile struct
-                tileSprite.setColor(sf::Color(255, 255, 255, static_cast<sf::Uint8>(layer.opacity * 255)));
-                tileSprite.setPosition(tilePosition - offset); // adjust the tile position with panning offset
-                target.draw(tileSprite);    // draw the tile sprite in position
-            }
-        }
-    }
-    sf::RectangleShape line;    // create line shape to draw grid with
-    line.setFillColor(sf::Color(100, 100, 100, 150));
-    float startX = -offset.x;
-    float startY = -offset.y;
-    // iterate from the starting offset up to the grids width and height (layer width/height * layer tile size) and draw the grid lines
-    for (float x = startX; x <= layer.width * layerTileSize - offset.x; x += layerTileSize) {
-        line.setSize(sf::Vector2f(1.f, layer.height * layerTileSize)); // height of the grid
-        line.setPosition(x, -offset.y); // position of each drawn line relative to the offset caused by panning
-        target.draw(line);
-    }
-    // same here but for horizontal grid lines
-    for (float y = startY; y <= layer.height * layerTileSize - offset.y; y += layerTileSize) {
-        line.setSize(sf::Vector2f(layer.width * layerTileSize, 1.f)); // width of the grid
-        line.setPosition(-offset.x, y);
-        target.draw(line);
-    }
-}
-
-void TileMap::HandlePanning(sf::Vector2f mousePos, bool isPanning, float deltaTime) {
-    static sf::Vector2f lastMousePos = mousePos;
-    if (isPanning) {
-        if (lastMousePos != mousePos) {
-            sf::Vector2f delta = lastMousePos - mousePos;
-            editor.GetLayerView().move(delta);  // update camera/view position
-            editor.layerViewOffset += delta;    // update the grid offset
-            
+    // any fill above the threshold would hitch (a whole 4096x4096 fixed layer is 16M cells, an infinite one has no limit at all),
+    // so it is written a row of chunks per step instead
+    int chunkSize = layer.chunkSize;
+    int firstRow = FloorDiv(clipped.top, chunkSize);
+    size_t rowCount = static_cast<size_t>(FloorDiv(clipped.top + clipped.height - 1, chunkSize) - firstRow + 1);
+    std::uint64_t layerId = layer.id;
+    std::string layerNumber = std::to_string(activeLayerIndex + 1);
+    StartMapTask(editor.GetScheduler().StartLoop((cell == EmptyCell ? "Erasing on layer " : "Filling layer ") + layerNumber, rowCount, [this, clipped, cell, layerId, firstRow, chunkSize](size_t i) {
+        TileLayer* layer = FindLayer(layerId);
+        if (!layer) return; // the layer is gone, the remaining steps do nothing
+        int top = std::max(clipped.top, (firstRow + static_cast<int>(i)) * chunkSize);
+        int bottom = std::min(clipped.top + clipped.height, (firstRow + static_cast<int>(i) + 1) * chunkSize);
+        if (layer->WriteArea(sf::IntRect(clipped.left, top, clipped.width, bottom - top), &cell, 0, revision + 1)) {
+            ++revision;
+            editor.RequestRedraw();
         }
+    }, nullptr, [this, layerNumber] {
+        statusMessage = "Stopped filling layer " + layerNumber + ", rows already written stay";
+        editor.RequestRedraw();
+    }));
+}
+
+void TileMap::HandleRectFill(const sf::Vector2f& mousePos, bool isDragging, bool isErasing) {
+    sf::Vector2i gridPos(static_cast<int>(std::floor(mousePos.x / editor.baseTileSize)), static_cast<int>(std::floor(mousePos.y / editor.baseTileSize)));
+    if (isDragging) {
+        if (!isFillingRect) {
+            isFillingRect = true;   // start a new rect on the tile under the cursor
+            isErasingRect = isErasing;
+            fillStart = gridPos;
+            editor.RequestRedraw();
+        }
+        if (fillEnd != gridPos) { editor.RequestRedraw(); }    // the drag rectangle only changes when the end tile does
+        fillEnd = gridPos;
+        return;
+    }
+    if (!isFillingRect) return;
+    // the button was released, the rect is written with the top left tile of the atlas selection or erased
+    isFillingRect = false;
+    fillEnd = gridPos;
+    editor.RequestRedraw(); // remove the drag rectangle
+    if (isErasingRect) {
+        FillRegion(GetFillRect(), EmptyCell);
+        return;
+    }
+    const TileAtlas::SelectedTile& selectedTile = tileAtlas.GetSelectedTile();
+    if (selectedTile.textureRects.empty()) return;
+    FillRegion(GetFillRect(), MakeTileCell(tileAtlas.GetTileIndex(selectedTile.textureRects.front())));
+}
+
+sf::IntRect TileMap::GetFillRect() const {
+    int left = std::min(fillStart.x, fillEnd.x);
+    int top = std::min(fillStart.y, fillEnd.y);
+    return sf::IntRect(left, top, std::max(fillStart.x, fillEnd.x) - left + 1, std::max(fillStart.y, fillEnd.y) - top + 1);
+}
+
+void TileMap::HandleTileRemoval(const sf::Vector2f& mousePos) {
+    // convert mouse position to grid coordinates the same way as placement, then erase the tile under the cursor
+    int gridX = static_cast<int>(std::floor(mousePos.x / editor.baseTileSize));
+    int gridY = static_cast<int>(std::floor(mousePos.y / editor.baseTileSize));
+    RemoveTile(gridX, gridY);
+}
+
+void TileMap::AddToFrame(RenderFrame& frame) {
+    frame.tileSize = editor.baseTileSize;
+    frame.compositeChunkSize = compositeChunkSize;
+    frame.mergedArea = GetVisibleTiles(frame.layerView);
+    // the merged view bakes whole composite chunks, so the inactive layers are captured out to the composite chunk edges
+    if (showMergedLayers && frame.mergedArea.width > 0 && frame.mergedArea.height > 0) {
+        int left = FloorDiv(frame.mergedArea.left, compositeChunkSize) * compositeChunkSize;
+        int top = FloorDiv(frame.mergedArea.top, compositeChunkSize) * compositeChunkSize;
+        int right = (FloorDiv(frame.mergedArea.left + frame.mergedArea.width - 1, compositeChunkSize) + 1) * compositeChunkSize;
+        int bottom = (FloorDiv(frame.mergedArea.top + frame.mergedArea.height - 1, compositeChunkSize) + 1) * compositeChunkSize;
+        sf::IntRect compositeArea(left, top, right - left, bottom - top);
+        for (TileLayer& layer : layers) {
+            if (layer.index == activeLayerIndex || !layer.isVisible) continue;  // the composite holds every visible layer except the active one
+            frame.mergedLayers.emplace_back();
+            CaptureLayer(layer, compositeArea, 128, frame.mergedLayers.back());
+        }
+    }
+    if (activeLayerIndex < 0 || activeLayerIndex >= layers.size()) {  // don't try to draw the layer grid if a layer grid has not been created via the ui buttons
+        std::cerr << "Invalid layer index for rendering: " << activeLayerIndex << "\n";
+        return;
+    }
+    TileLayer& layer = layers[activeLayerIndex]; // get the active TileLayer instance from the layers vector
+    sf::IntRect visible = GetVisibleTiles(frame.layerView, layer);
+    // the tiles of the active layer are drawn chunk by chunk, one draw call per chunk
+    CaptureLayer(layer, visible, static_cast<sf::Uint8>(layer.opacity * 255), frame.activeLayer);
+    frame.hasActiveLayer = true;
+    // only grid lines bordering on-screen cells are drawn, batched into a single draw call
+    frame.layerItems.push_back(editor.CreateGrid(frame.layerView, visible, static_cast<float>(editor.baseTileSize)));
+    // the rect fill being dragged, green for a fill and red for an erase
+    if (isFillingRect) {
+        sf::IntRect area = GetFillRect();
+        float tileSize = static_cast<float>(editor.baseTileSize);
+        std::shared_ptr<sf::RectangleShape> fillRect = std::make_shared<sf::RectangleShape>(sf::Vector2f(area.width * tileSize, area.height * tileSize));
+        fillRect->setPosition(area.left * tileSize, area.top * tileSize);
+        fillRect->setFillColor(isErasingRect ? sf::Color(255, 0, 0, 100) : sf::Color(0, 255, 0, 100));
+        frame.layerItems.push_back(fillRect);
+    }
+}
+
+void TileMap::CaptureLayer(TileLayer& layer, const sf::IntRect& area, sf::Uint8 alpha, RenderFrame::Layer& captured) {
+    captured.id = layer.id;
+    captured.chunkSize = layer.chunkSize;
+    captured.alpha = alpha;
+    if (area.width <= 0 || area.height <= 0) return;
+    if (layer.chunks.empty()) return;
+    int firstChunkX = FloorDiv(area.left, layer.chunkSize);
+    int firstChunkY = FloorDiv(area.top, layer.chunkSize);
+    int lastChunkX = FloorDiv(area.left + area.width - 1, layer.chunkSize);
+    int lastChunkY = FloorDiv(area.top + area.height - 1, layer.chunkSize);
+    // the frame shares the cells, marking them read only makes the next edit copy the chunk instead of changing what the renderer reads
+    auto capture = [&captured](std::int64_t key, TileChunk& chunk) {
+        chunk.isReadOnly = true;
+        captured.chunks.push_back({ key, chunk.revision, chunk.cells });
+    };
+    // look up the chunk coordinates in the area when there are fewer of them than stored chunks, otherwise walk the stored chunks and skip the ones outside
+    size_t areaChunks = static_cast<size_t>(lastChunkX - firstChunkX + 1) * (lastChunkY - firstChunkY + 1);
+    if (areaChunks <= layer.chunks.size()) {
+        for (int chunkY = firstChunkY; chunkY <= lastChunkY; ++chunkY) {
+            for (int chunkX = firstChunkX; chunkX <= lastChunkX; ++chunkX) {
+                std::int64_t key = MakeChunkKey(chunkX, chunkY);
+                auto it = layer.chunks.find(key);
+                if (it != layer.chunks.end()) { capture(key, it->second); }
+            }
+        }
+    }
+    else {
+        for (auto& entry : layer.chunks) {
+            int chunkX = GetChunkKeyX(entry.first);
+            int chunkY = GetChunkKeyY(entry.first);
+            if (chunkX < firstChunkX || chunkX > lastChunkX || chunkY < firstChunkY || chunkY > lastChunkY) continue;
+            capture(entry.first, entry.second);
+        }
+    }
+}
+
+sf::IntRect TileMap::GetVisibleTiles(const sf::View& view, const TileLayer& layer) const {
+    sf::IntRect visible = GetVisibleTiles(view);
+    // fixed size layers are clamped to their grid, infinite layers extend across the whole view
+    if (!layer.isInfinite) {
+        int right = std::min(layer.width, visible.left + visible.width);
+        int bottom = std::min(layer.height, visible.top + visible.height);
+        visible.left = std::max(0, visible.left);
+        visible.top = std::max(0, visible.top);
+        visible.width = right - visible.left;
+        visible.height = bottom - visible.top;
+    }
+    return visible;  // width or height is zero or negative when the layer is off screen
+}
+
+sf::IntRect TileMap::GetVisibleTiles(const sf::View& view) const {
+    // the part of the view that is on screen, already in world space since the view carries zoom and panning
+    sf::FloatRect area = editor.GetVisibleArea(view);
+    float tileSize = static_cast<float>(editor.baseTileSize);
+    // convert to tile coordinates, rounding outwards so partially visible tiles are kept
+    int left = static_cast<int>(std::floor(area.left / tileSize));
+    int top = static_cast<int>(std::floor(area.top / tileSize));
+    int right = static_cast<int>(std::ceil((area.left + area.width) / tileSize));
+    int bottom = static_cast<int>(std::ceil((area.top + area.height) / tileSize));
+    return sf::IntRect(left, top, right - left, bottom - top);
+}
+
+void TileMap::HandlePanning(sf::Vector2i mousePos, bool isPanning, float deltaTime) {
+    // mouse positions are in window pixels so the pan distance doesn't change as the view moves under the cursor
+    static sf::Vector2i lastMousePos = mousePos;
+    if (isPanning) {
+        editor.PanView(editor.GetLayerView(), lastMousePos, mousePos);  // update camera/view position
         lastMousePos = mousePos;    // update last mouse position each frame
     }
     else {
@@ -131,151 +578,1270 @@ void TileMap::HandlePanning(sf::Vector2f mousePos, bool isPanning, float deltaTi
     }
 }
 
-void TileMap::UpdateTileScale(float scaleFactor) {
-    layerScaleFactor = scaleFactor;
-    layerTileSize = editor.baseTileSize * layerScaleFactor;
+void TileMap::ToggleVisibility() {
+    if (activeLayerIndex < 0 || activeLayerIndex >= layers.size()) return;
+    layers[activeLayerIndex].isVisible = !layers[activeLayerIndex].isVisible;
+    layoutRevision = ++revision;
+    editor.RequestRedraw();     // hidden layers are left out of the merged view
+}
+
+void TileMap::ClearLayer() {
+    if (activeLayerIndex < 0 || activeLayerIndex >= layers.size() || activeLoad) return;
+    TileLayer& layer = layers[activeLayerIndex];
+    if (layer.chunks.empty()) return;
+    // freeing every chunk of a big layer takes long enough to hitch, so the chunks there are now are erased a slice per frame
+    // tiles painted into one of them before its turn go with it, chunks created in the meantime stay
+    std::shared_ptr<std::vector<std::int64_t>> keys = std::make_shared<std::vector<std::int64_t>>();
+    keys->reserve(layer.chunks.size());
+    for (const auto& entry : layer.chunks) { keys->push_back(entry.first); }
+    std::uint64_t layerId = layer.id;
+    std::string layerNumber = std::to_string(activeLayerIndex + 1);
+    StartMapTask(editor.GetScheduler().StartLoop("Clearing layer " + layerNumber, keys->size(), [this, keys, layerId](size_t i) {
+        TileLayer* layer = FindLayer(layerId);
+        if (!layer) return; // the layer is gone, the remaining slices do nothing
+        std::int64_t key = (*keys)[i];
+        if (layer->chunks.erase(key) == 0) return;
+        layer->StampChunk(key, ++revision);    // recorded as removed, so an incremental save erases it from the file as well
+        layer->isBoundsStale = true;
+        editor.RequestRedraw();
+    }, nullptr, [this, layerNumber] {
+        statusMessage = "Stopped clearing layer " + layerNumber + ", erased tiles stay erased";
+        editor.RequestRedraw();
+    }));
+}
 
+TileMap::TileLayer* TileMap::FindLayer(std::uint64_t id) {
     for (TileLayer& layer : layers) {
-        for (int y = 0; y < layer.height; ++y) {
-            for (int x = 0; x < layer.width; ++x) {
-                Tile& tile = layer.layer[y][x];
-                if (tile.index >= 0) { // update only valid tiles
-                    tile.sprite.setScale(layerScaleFactor, layerScaleFactor);
-                    tile.sprite.setPosition(x * layerTileSize, y * layerTileSize);
-                }
+        if (layer.id == id) return &layer;
+    }
+    return nullptr;
+}
+
+void TileMap::StartMapTask(FrameScheduler::TaskId id) {
+    FrameScheduler& scheduler = editor.GetScheduler();
+    mapTasks.erase(std::remove_if(mapTasks.begin(), mapTasks.end(), [&scheduler](FrameScheduler::TaskId task) { return !scheduler.IsRunning(task); }), mapTasks.end());
+    mapTasks.push_back(id);
+}
+
+void TileMap::FinishMapTasks() {
+    // like waiting for saves, whatever was asked for before a load or a blocking save is done first
+    std::vector<FrameScheduler::TaskId> tasks;
+    tasks.swap(mapTasks);
+    for (FrameScheduler::TaskId task : tasks) { editor.GetScheduler().Finish(task); }
+}
+
+/*  json map schema, version 2:
+    mapData = { "version", "tileSize", "atlas": { "image", "columns" }, "layers": [ layerData... ] }
+    layerData = { "width", "height", "isInfinite", "originX", "originY", "isVisible", "opacity", "data" }
+    data = width * height tile cells in row-major order, 0 is an empty cell and any other value is the atlas index + 1
+    with the orientation flags in the top 3 bits (the same ids and flag bits Tiled uses for a tileset starting at 1)
+    infinite layers only store the rect covering their tiles, originX/originY give its top left corner
+    version 1 maps stored "tiles" instead of "data", an array of rows holding null or an object with an "index" per cell, they still load
+*/
+
+bool TileMap::SaveTileMap(const std::string& filename) {
+    // an earlier background save of the same file must not finish after this one
+    FinishMapTasks();
+    saver.Wait();
+    std::atomic<float> progress{ 0.f };
+    bool isSaved = CreateSaveJob(filename)(progress);
+    if (isSaved) { PruneRemovedChunks(); }
+    return isSaved;
+}
+
+void TileMap::SaveTileMapAsync(const std::string& filename) {
+    if (activeLoad) {
+        // only part of the map being loaded is there yet
+        statusMessage = "Can't save while a map is loading";
+        editor.RequestRedraw();
+        return;
+    }
+    StartSave(filename, false);
+}
+
+void TileMap::StartSave(const std::string& filename, bool isAutosave) {
+    saver.Enqueue(filename, isAutosave, CreateSaveJob(filename));
+}
+
+MapSaver::SaveJob TileMap::CreateSaveJob(const std::string& filename) {
+    // a .tmb file that was written or loaded before only gets the edited chunks appended to its journal,
+    // unless the layers themselves changed or the journal has grown big enough that rewriting the file compacts it
+    std::shared_ptr<MapJournal> journal;
+    bool isIncremental = false;
+    std::uint64_t journalRevision = 0;
+    if (HasMapFileExtension(filename)) {
+        std::shared_ptr<MapJournal>& entry = journals[filename];
+        if (!entry) entry = std::make_shared<MapJournal>();
+        journal = entry;
+        std::lock_guard<std::mutex> lock(journal->mutex);
+        // a save of this file that is still queued may bump the journal's revision, which only shrinks what the append has to write
+        isIncremental = CanAppendToJournal(*journal);
+        journalRevision = journal->revision;
+    }
+    // chunks, frames and queued snapshots may still point into a mapped file this overwrites, a full save writes a new file and renames it over the old one,
+    // which stays readable through its mappings until the last one is closed
+    std::shared_ptr<const MapSnapshot> snapshot = CreateSnapshot(isIncremental, journalRevision);
+    return [snapshot, filename, journal](std::atomic<float>& progress) {
+        if (snapshot->isIncremental) return AppendMapJournal(*snapshot, filename, *journal, progress);
+        return WriteTileMap(*snapshot, filename, journal.get(), progress);
+    };
+}
+
+bool TileMap::CanAppendToJournal(const MapJournal& journal) const {
+    return journal.hasBase && layoutRevision <= journal.revision
+        && journal.journalSize < journal.baseSize * static_cast<double>(journalCompactionRatio);
+}
+
+std::shared_ptr<const TileMap::MapSnapshot> TileMap::CreateSnapshot(bool isIncremental, std::uint64_t journalRevision) {
+    std::shared_ptr<MapSnapshot> snapshot = std::make_shared<MapSnapshot>();
+    snapshot->revision = revision;
+    snapshot->isIncremental = isIncremental;
+    snapshot->tileSize = editor.baseTileSize;
+    snapshot->atlasPath = tileAtlas.atlasPath;
+    snapshot->atlasColumns = tileAtlas.atlasColumns;
+    snapshot->prettyPrintJson = prettyPrintJson;
+    snapshot->binaryCompression = binaryCompression;
+    snapshot->jsonCompression = jsonCompression;
+    snapshot->layers.reserve(layers.size());
+    for (TileLayer& layer : layers) {
+        // only the saved state is copied, the chunk map holds shared pointers so no cells are copied here
+        snapshot->layers.emplace_back();
+        TileLayer& copy = snapshot->layers.back();
+        copy.width = layer.width;
+        copy.height = layer.height;
+        copy.isVisible = layer.isVisible;
+        copy.opacity = layer.opacity;
+        copy.index = layer.index;
+        copy.chunkSize = layer.chunkSize;
+        copy.isInfinite = layer.isInfinite;
+        if (isIncremental) {
+            // the journal already holds everything up to its revision, so only the chunks edited since then are captured
+            for (auto& entry : layer.chunks) {
+                if (entry.second.revision <= journalRevision) continue;
+                entry.second.isReadOnly = true;
+                copy.chunks.insert(entry);
             }
+            for (const auto& entry : layer.removedChunks) {
+                if (entry.second > journalRevision) copy.removedChunks.insert(entry);
+            }
+            continue;
         }
+        copy.tileBounds = layer.GetTileBounds();    // worked out here so the worker never updates the lazy bounds
+        // the live chunks now share their cells with the snapshot, so the next edit of each one copies it first
+        for (auto& entry : layer.chunks) { entry.second.isReadOnly = true; }
+        copy.chunks = layer.chunks;
     }
+    return snapshot;
 }
 
-void TileMap::MergeAllLayers(sf::RenderTarget& target, bool showMergedLayers) {
-    if (!showMergedLayers) return;  // if showMergedLayers was passed in as false, exit early
-    sf::Vector2f offset = editor.layerViewOffset;   // get the offset from panning
-    for (int i = 0; i < layers.size(); ++i) {   // loop through the layers vector drawing each layer with half opacity
-        if (i == activeLayerIndex) continue;    // when the loop reaches the active layer, skip it as its already drawn
-        const TileLayer& layer = layers[i]; // set layer variable to the current layer index the loop is at
-        // if (!layer.isVisible) continue; // skip invisible layers
-        // loop through the width and height of each current layer index drawing its' sprite tiles at half opacity
-        for (int y = 0; y < layer.height; ++y) {
-            for (int x = 0; x < layer.width; ++x) {
-                const Tile& tile = layer.layer[y][x];   // get the tile at each width & height position from the current layer
-                if (tile.index >= 0) {  // only draw valid tiles 
-                    sf::Sprite tileSprite = tile.sprite;    // copy the tile sprite at this width and height of the layer being looped through
-                    tileSprite.setColor(sf::Color(255, 255, 255, 128)); // set the sprite to half opacity
-                    tileSprite.setPosition(
-                        (x * layerTileSize) - offset.x,
-                        (y * layerTileSize) - offset.y
-                    );  // adjust the tile position relative to the offset
-                    tileSprite.setScale(layerScaleFactor, layerScaleFactor);    // make sure it scales to the active layer's size if its' been zoomed
-                    target.draw(tileSprite);
-                }
-            }
+void TileMap::UpdateSaves() {
+    MapSaver::Result result;
+    bool isAnySaved = false;
+    while (saver.Poll(result)) {
+        statusMessage = (result.isSaved ? (result.isAutosave ? "Autosaved " : "Saved ") : "Failed to save ") + result.filename;
+        isAnySaved |= result.isSaved;
+        editor.RequestRedraw();
+    }
+    if (isAnySaved) { PruneRemovedChunks(); }
+    // an edited map is autosaved once the interval has passed, but never while another save is still being written
+    if (IsAutosavePending() && autosaveClock.getElapsedTime().asSeconds() >= autosaveInterval && !saver.IsBusy()) {
+        autosavedRevision = revision;
+        autosaveClock.restart();
+        StartSave(autosaveFilename, true);
+    }
+    // keep redrawing while a save is in flight so its progress is shown
+    bool isSaving = saver.IsBusy();
+    if (isSaving != isSaveAnimating) {
+        isSaveAnimating = isSaving;
+        if (isSaving) { editor.BeginAnimation(); }
+        else { editor.EndAnimation(); }
+    }
+}
+
+void TileMap::PruneRemovedChunks() {
+    // an erase is only written by incremental saves of journals older than it, once every journal that can still be appended to holds it
+    // (or there is none) its record can go, while a save is still queued its journal's revision isn't final yet
+    if (saver.IsBusy()) return;
+    std::uint64_t heldRevision = revision;
+    for (const auto& entry : journals) {
+        std::lock_guard<std::mutex> lock(entry.second->mutex);
+        if (entry.second->hasBase && layoutRevision <= entry.second->revision) heldRevision = std::min(heldRevision, entry.second->revision);
+    }
+    for (TileLayer& layer : layers) {
+        for (auto it = layer.removedChunks.begin(); it != layer.removedChunks.end();) {
+            if (it->second <= heldRevision) it = layer.removedChunks.erase(it);
+            else ++it;
         }
     }
 }
 
-/*  object flow for saving and loading map data from files:
-    tileData = object that holds an individual tiles properties like position, index etc.
-    row = object that holds a full row of tileData objects
-    tiles = object that holds multiple row objects that make up a full layer
-    layerData = object that holds all data about a layer like dimensions, opacity, tiles etc.
-    mapData = object that holds every layer
-    tileData->row->tiles->layerData["tiles"]->mapData["layers"]
+std::string TileMap::GetStatus() const {
+    if (activeLoad) return "Loading " + activeLoad->filename + "... " + std::to_string(static_cast<int>(activeLoad->progress * 100.f)) + "% (Esc to cancel)";
+    std::string filename = saver.GetCurrentFilename();
+    if (!filename.empty()) return "Saving " + filename + "... " + std::to_string(static_cast<int>(saver.GetProgress() * 100.f)) + "%";
+    return statusMessage;
+}
+
+bool TileMap::WriteTileMap(const MapSnapshot& snapshot, const std::string& filename, MapJournal* journal, std::atomic<float>& progress) {
+    // the .tmb extension selects the binary format, everything else is saved as json
+    if (HasMapFileExtension(filename)) {
+        return WriteBinaryTileMap(snapshot, filename, journal, progress);
+    }
+    FileWriter file(filename);
+    if (!file.IsOpen()) {
+        std::cerr << "Failed to open file for saving: " << filename << "\n";
+        return false;
+    }
+    // compressed layers are encoded up front, one layer per task on the thread pool
+    std::vector<const TileCodec*> layerCodecs(snapshot.layers.size(), nullptr);
+    std::vector<std::string> encodedLayers(snapshot.layers.size());
+    if (snapshot.jsonCompression != CodecPreference::Fastest) {
+        ThreadPool::GetShared().ParallelFor("encode json layers", snapshot.layers.size(), [&](size_t i) {
+            // a compressed layer stores the encoded cells of its whole rect as a base64 string
+            const TileLayer& layer = snapshot.layers[i];
+            std::vector<TileCell> cells = layer.CopyArea(layer.isInfinite ? layer.GetTileBounds() : sf::IntRect(0, 0, layer.width, layer.height));
+            std::vector<const TileCell*> chunkCells{ cells.data() };
+            const TileCodec* codec = GetTileCodec(ChooseLayerCodec(snapshot.jsonCompression, chunkCells, cells.size()));
+            if (codec->id == LayerCodec::None) return;
+            std::vector<char> payload;
+            ByteWriter out(payload);
+            codec->encode(cells.data(), cells.size(), out);
+            layerCodecs[i] = codec;
+            encodedLayers[i] = EncodeBase64(payload.data(), payload.size());
+        });
+    }
+    // the json is streamed out while the layers are walked, each full block goes to the disk while the next one is formatted
+    JsonWriter json(file.GetStream(), snapshot.prettyPrintJson);
+    json.BeginObject();
+    json.Key("version");
+    json.Int(2);
+    json.Key("tileSize");
+    json.Int(snapshot.tileSize);
+    json.Key("atlas");
+    json.BeginObject();
+    json.Key("image");
+    json.String(snapshot.atlasPath);
+    json.Key("columns");
+    json.Int(snapshot.atlasColumns);
+    json.EndObject();
+    json.Key("layers");
+    json.BeginArray();
+    for (size_t i = 0; i < snapshot.layers.size(); ++i) {
+        const TileLayer& layer = snapshot.layers[i];
+        progress = static_cast<float>(i) / snapshot.layers.size();
+        // infinite layers store only the rect covering their tiles, with its top left corner as the origin
+        sf::IntRect area = layer.isInfinite ? layer.GetTileBounds() : sf::IntRect(0, 0, layer.width, layer.height);
+        json.BeginObject();
+        json.Key("width");
+        json.Int(area.width);
+        json.Key("height");
+        json.Int(area.height);
+        if (layer.isInfinite) {
+            json.Key("isInfinite");
+            json.Bool(true);
+            json.Key("originX");
+            json.Int(area.left);
+            json.Key("originY");
+            json.Int(area.top);
+        }
+        json.Key("isVisible");
+        json.Bool(layer.isVisible);
+        json.Key("opacity");
+        json.Float(layer.opacity);
+        if (layerCodecs[i]) {
+            json.Key("codec");
+            json.String(layerCodecs[i]->name);
+            json.Key("data");
+            json.String(encodedLayers[i]);
+            json.EndObject();
+            continue;
+        }
+        // the cells are written as one flat array, pretty printing puts each row of the layer on its own line
+        // bands of rows are formatted on the thread pool and appended in order, giving the same text as writing cell by cell
+        json.Key("data");
+        json.BeginArray(area.width);
+        JsonWriter::ArrayLayout layout = json.GetArrayLayout();
+        int bandHeight = std::max(1, 16384 / std::max(area.width, 1));
+        int bandCount = area.width > 0 ? (area.height + bandHeight - 1) / bandHeight : 0;
+        std::vector<std::string> bands(std::max(bandCount, 0));
+        ThreadPool::GetShared().ParallelFor("write json bands", bands.size(), [&](size_t b) {
+            int top = area.top + static_cast<int>(b) * bandHeight;
+            std::vector<TileCell> cells = layer.CopyArea(sf::IntRect(area.left, top, area.width, std::min(bandHeight, area.top + area.height - top)));
+            JsonWriter::AppendInts(bands[b], layout, b * bandHeight * static_cast<size_t>(area.width), cells.data(), cells.size());
+        });
+        for (size_t b = 0; b < bands.size(); ++b) {
+            json.Fragment(bands[b], static_cast<size_t>(std::min(bandHeight, area.height - static_cast<int>(b) * bandHeight)) * area.width);
+            std::string().swap(bands[b]);
+        }
+        json.EndArray();
+        json.EndObject();
+    }
+    json.EndArray();
+    json.EndObject();
+    json.Flush();
+    progress = 1.f;
+    return file.Finish();    // return true if saving succeeded
+}
+
+/*  the json loader never builds a document, JsonMapReader pulls tokens from the file and writes tiles into the layers as they arrive
+    keys are only compared once when they are read, and anything the loader doesn't know (including the derived textureRect and
+    position of a tile) is skipped without being stored
 */
+struct TileMap::JsonMapReader {
+    typedef JsonReader::Token Token;
+    JsonReader& json;
+    MapLoad& load;  // receives each layer once it is complete
+    std::string error;
+
+    double version = 1;   // files written before the version field existed are version 1
+    double tileSize = 0;
+    bool reportsProgress = true;    // readers of a single layer leave the progress to the reader of the whole file
+
+    JsonMapReader(JsonReader& json, MapLoad& load) : json(json), load(load) {}
 
-bool TileMap::SaveTileMap(const std::string& filename) const {
-    nlohmann::json mapData; // initialize json object to store the overall map data which consists of every layer (and their individual data)
-    for (const auto& layer : layers) {  // iterate over all TileLayer objects (layer) in the layers vector
-        nlohmann::json layerData;   // for each layer, a new json object called layerData is initialized to hold its data (dimensions, visiblity, opacity)
-        layerData["width"] = layer.width;
-        layerData["height"] = layer.height;
-        layerData["isVisible"] = layer.isVisible;
-        layerData["opacity"] = layer.opacity;
-        // initialize json object to store rows of tiles from each layer
-        nlohmann::json tiles;
-        // for each row (y) in the layer, iterate through each tile (x) and construct a json representation for it
-        for (int y = 0; y < layer.height; ++y) {
-            nlohmann::json row; // initialize json object to store all tiles (tileData) that make up a row
-            for (int x = 0; x < layer.width; ++x) {
-                const Tile& tile = layer.layer[y][x];
-                if (tile.index >= 0) {  // if the tile at layer[y][x] isn't empty, capture its properties and store in tileData json object
-                    nlohmann::json tileData;
-                    tileData["index"] = tile.index;
-                    tileData["textureRect"] = {
-                        {"left", tile.sprite.getTextureRect().left},
-                        {"top", tile.sprite.getTextureRect().top},
-                        {"width", tile.sprite.getTextureRect().width},
-                        {"height", tile.sprite.getTextureRect().height}
-                    };
-                    tileData["position"] = {
-                        {"x", tile.sprite.getPosition().x},
-                        {"y", tile.sprite.getPosition().y}
-                    };
-                    row.push_back(tileData);    // push each the serialized tile into the row object
+    // called between rows, reports how far into the file the reader is and stops once the load is cancelled
+    bool CheckProgress() {
+        if (reportsProgress) load.progress = static_cast<float>(json.GetPosition()) / static_cast<float>(std::max<size_t>(json.GetSize(), 1));
+        return !load.isCancelled || Fail("cancelled");
+    }
+
+    bool Fail(const std::string& message) {
+        if (error.empty()) error = json.GetError().empty() ? message + " at byte " + std::to_string(json.GetOffset() + json.GetPosition()) : json.GetError();
+        return false;
+    }
+
+    bool ReadString(std::string& value) {
+        Token token = json.Next();
+        if (token == Token::String) value = json.GetText();
+        else if (!json.SkipValue(token)) return Fail("invalid value");
+        return true;
+    }
+
+    // reads a number (or bool) value, anything else is skipped and leaves value untouched
+    bool ReadNumber(double& value) {
+        Token token = json.Next();
+        if (token == Token::Number) value = json.GetNumber();
+        else if (token == Token::True || token == Token::False) value = token == Token::True ? 1 : 0;
+        else if (!json.SkipValue(token)) return Fail("invalid value");
+        return true;
+    }
+
+    bool ReadMap() {
+        if (json.Next() != Token::BeginObject) return Fail("expected a map object");
+        for (Token token = json.Next(); token != Token::EndObject; token = json.Next()) {
+            if (token != Token::Key) return Fail("invalid map object");
+            const std::string& key = json.GetText();
+            bool isRead = true;
+            if (key == "layers") isRead = ReadLayers();
+            else if (key == "version") isRead = ReadNumber(version) && (version <= 2 || Fail("unsupported map version " + std::to_string(static_cast<int>(version))));
+            else if (key == "tileSize") isRead = ReadNumber(tileSize);
+            else isRead = json.SkipValue(json.Next());
+            if (!isRead) return Fail("invalid value");
+        }
+        return json.Next() == Token::End || Fail("unexpected data after the map");
+    }
+
+    bool ReadLayers() {
+        Token token = json.Next();
+        if (token == Token::Null) return true;
+        if (token != Token::BeginArray) return Fail("expected a layers array");
+        if (ThreadPool::GetShared().GetThreadCount() == 1) {
+            // nothing to spread the layers over, so they are parsed in place without the extra scan
+            for (int fileIndex = 0; (token = json.Next()) != Token::EndArray; ++fileIndex) {
+                if (token != Token::BeginObject) return Fail("invalid layer");
+                if (!load.IsLayerWanted(fileIndex)) {
+                    // json has no table of contents, layers that weren't asked for are still scanned but never parsed
+                    if (!json.SkipValue(token)) return Fail("invalid layer");
+                    continue;
                 }
-                else {
-                    row.push_back(nullptr); // else if the tile at layer[y][x] was empty, push back a nullptr to represent an empty tile
+                TileLayer newLayer;
+                if (!ReadLayer(newLayer, load.layerCount)) return Fail("invalid layer");
+                load.AddLayer(std::move(newLayer), fileIndex);
+            }
+            return true;
+        }
+        // the layer objects are only bracket-scanned here, then each one is parsed on the thread pool by a reader of its own
+        std::vector<std::pair<size_t, size_t>> ranges;
+        std::vector<int> fileIndices;
+        for (int fileIndex = 0; (token = json.Next()) != Token::EndArray; ++fileIndex) {
+            size_t start = json.GetPosition() - 1;
+            if (token != Token::BeginObject || !json.SkipValue(token)) return Fail("invalid layer");
+            if (!load.IsLayerWanted(fileIndex)) continue;
+            ranges.push_back({ start, json.GetPosition() });
+            fileIndices.push_back(fileIndex);
+        }
+        int firstIndex = load.layerCount;
+        std::vector<TileLayer> readLayers(ranges.size());
+        std::vector<char> isRead(ranges.size(), 0);
+        std::mutex mutex;   // guards isRead, nextLayer and the error
+        size_t nextLayer = 0;   // layers are handed over in file order, each one as soon as every layer before it is done
+        size_t errorLayer = ranges.size();
+        std::string layerError;
+        ThreadPool::GetShared().ParallelFor("read json layers", ranges.size(), [&](size_t l) {
+            if (load.isCancelled) return;
+            JsonReader layerJson(json.GetData() + ranges[l].first, ranges[l].second - ranges[l].first, json.GetOffset() + ranges[l].first);
+            JsonMapReader layerReader(layerJson, load);
+            layerReader.reportsProgress = false;
+            bool isLayerRead = layerJson.Next() == Token::BeginObject && layerReader.ReadLayer(readLayers[l], firstIndex + static_cast<int>(l))
+                && (layerJson.Next() == Token::End || layerReader.Fail("invalid layer"));
+            std::lock_guard<std::mutex> lock(mutex);
+            if (!isLayerRead) {
+                // the first broken layer in the file is reported, whichever thread got there first
+                if (l < errorLayer) {
+                    errorLayer = l;
+                    layerError = layerReader.error.empty() ? "invalid layer" : layerReader.error;
                 }
+                return;
+            }
+            isRead[l] = 1;
+            for (; nextLayer < ranges.size() && isRead[nextLayer] && nextLayer < errorLayer; ++nextLayer) {
+                load.AddLayer(std::move(readLayers[nextLayer]), fileIndices[nextLayer]);
+                if (reportsProgress) load.progress = static_cast<float>(ranges[nextLayer].second) / static_cast<float>(json.GetSize());
             }
-            tiles.push_back(row);   // push the entire row into the tiles object which holds all the tiles in a layer
+        });
+        if (errorLayer < ranges.size()) {
+            error = layerError;
+            return false;
         }
-        layerData["tiles"] = tiles; // add the serialized tile data (tiles) into layerData["tiles"] array
-        mapData["layers"].push_back(layerData); // then push all of this layer iterations data (layerData) into the mapData["layers"] array
+        return !load.isCancelled || Fail("cancelled");
     }
-    // write the json data to a file which will be named whatever was typed during the ui interaction
-    std::ofstream file(filename);
-    if (!file.is_open()) {
-        std::cerr << "Failed to open file for saving: " << filename << "\n";
-        return false;
+
+    bool ReadLayer(TileLayer& newLayer, int index) {
+        newLayer.width = 0;
+        newLayer.height = 0;
+        newLayer.isVisible = true;
+        newLayer.opacity = 1.0f;
+        newLayer.index = index;
+        newLayer.chunkSize = load.chunkSize;
+        // infinite layers store their tiles relative to an origin, fixed layers always start at 0, 0
+        double width = 0, height = 0, isVisible = 1, opacity = 1, isInfinite = 0, originX = 0, originY = 0;
+        bool hasTiles = false;
+        bool isOriginLate = false;  // the origin came after the tiles (only in hand-edited files), so they are moved once the layer is read
+        bool isCroppedEarly = false;    // a partial load dropped the tiles outside its area while reading them, which needs the origin first
+        std::vector<TileCell> pendingData;
+        std::string codecName;
+        std::string encodedData;    // base64 data of a compressed layer, decoded once the codec and size are known
+        for (Token token = json.Next(); token != Token::EndObject; token = json.Next()) {
+            if (token != Token::Key) return Fail("invalid layer object");
+            const std::string& key = json.GetText();
+            bool isRead = true;
+            if (key == "width") isRead = ReadNumber(width);
+            else if (key == "height") isRead = ReadNumber(height);
+            else if (key == "isVisible") isRead = ReadNumber(isVisible);
+            else if (key == "opacity") isRead = ReadNumber(opacity);
+            else if (key == "isInfinite") isRead = ReadNumber(isInfinite);
+            else if (key == "originX") { isRead = ReadNumber(originX); isOriginLate |= hasTiles; }
+            else if (key == "originY") { isRead = ReadNumber(originY); isOriginLate |= hasTiles; }
+            else if (key == "tiles") { isRead = ReadTiles(newLayer, static_cast<int>(originX), static_cast<int>(originY)); hasTiles = true; isCroppedEarly = load.hasArea; }
+            else if (key == "codec") isRead = ReadString(codecName);
+            else if (key == "data") {
+                Token first = json.Next();
+                if (first == Token::String) encodedData = json.GetText();
+                // the flat array needs the layer width to place its cells, if it comes later the cells are kept until the layer is complete
+                else if (width > 0) { isRead = ReadData(first, newLayer, static_cast<int>(width), static_cast<int>(originX), static_cast<int>(originY), nullptr); isCroppedEarly = load.hasArea; }
+                else isRead = ReadData(first, newLayer, 0, 0, 0, &pendingData);
+                hasTiles = true;
+            }
+            else isRead = json.SkipValue(json.Next());
+            if (!isRead) return Fail("invalid layer value");
+            if (isOriginLate && isCroppedEarly) return Fail("a partial load needs the layer origin before its tiles");
+        }
+        newLayer.width = static_cast<int>(width);
+        newLayer.height = static_cast<int>(height);
+        newLayer.isVisible = isVisible != 0;
+        newLayer.opacity = static_cast<float>(opacity);
+        newLayer.isInfinite = isInfinite != 0;
+        if (!encodedData.empty()) {
+            const TileCodec* codec = FindTileCodec(codecName);
+            std::vector<char> payload;
+            if (!codec) return Fail("unknown layer codec \"" + codecName + "\"");
+            if (width < 0 || height < 0 || !DecodeBase64(encodedData, payload)) return Fail("invalid layer data");
+            pendingData.assign(static_cast<size_t>(width) * static_cast<size_t>(height), EmptyCell);
+            if (!codec->decode(payload.data(), payload.size(), pendingData.data(), pendingData.size())) return Fail("corrupt " + codecName + " layer data");
+        }
+        if (!pendingData.empty()) {
+            if (width <= 0) return Fail("layer data without a width");
+            // compressed layers are decoded whole, but a partial load only places the cells inside its area
+            size_t layerWidth = static_cast<size_t>(width);
+            size_t rowCount = (pendingData.size() + layerWidth - 1) / layerWidth;
+            size_t firstX = 0, endX = layerWidth, firstY = 0, endY = rowCount;
+            if (load.hasArea) {
+                firstX = static_cast<size_t>(std::max(0, std::min(load.area.left - static_cast<int>(originX), static_cast<int>(width))));
+                endX = static_cast<size_t>(std::max(static_cast<int>(firstX), std::min(load.area.left + load.area.width - static_cast<int>(originX), static_cast<int>(width))));
+                firstY = std::min(rowCount, static_cast<size_t>(std::max(0, load.area.top - static_cast<int>(originY))));
+                endY = std::max(firstY, std::min(rowCount, static_cast<size_t>(std::max(0, load.area.top + load.area.height - static_cast<int>(originY)))));
+            }
+            for (size_t y = firstY; y < endY; ++y) {
+                for (size_t x = firstX; x < endX && y * layerWidth + x < pendingData.size(); ++x) {
+                    newLayer.SetCell(static_cast<int>(originX) + static_cast<int>(x), static_cast<int>(originY) + static_cast<int>(y), pendingData[y * layerWidth + x]);
+                }
+            }
+        }
+        else if (isOriginLate) {
+            MoveLayerTiles(newLayer, static_cast<int>(originX), static_cast<int>(originY));
+        }
+        return CheckProgress();
+    }
+
+    // the v1 tile grid, an array of rows holding null for empty cells and an object per tile
+    bool ReadTiles(TileLayer& layer, int originX, int originY) {
+        Token token = json.Next();
+        if (token == Token::Null) return true;
+        if (token != Token::BeginArray) return false;
+        int y = 0;
+        for (token = json.Next(); token != Token::EndArray; token = json.Next(), ++y) {
+            if (!CheckProgress()) return false;
+            if (token == Token::Null) continue;
+            if (token != Token::BeginArray) return false;
+            // a partial load only scans rows and tiles outside its area for their closing brackets
+            if (load.hasArea && (originY + y < load.area.top || originY + y >= load.area.top + load.area.height)) {
+                if (!json.SkipValue(token)) return false;
+                continue;
+            }
+            int x = 0;
+            for (token = json.Next(); token != Token::EndArray; token = json.Next(), ++x) {
+                if (load.hasArea && (originX + x < load.area.left || originX + x >= load.area.left + load.area.width)) {
+                    if (!json.SkipValue(token)) return false;
+                }
+                else if (token == Token::BeginObject) {
+                    int index = -1;
+                    std::uint32_t flags = 0;
+                    if (!ReadTile(index, flags)) return false;
+                    // only the atlas index (and optional orientation flags) is needed, the texture rect and position are derived when drawing
+                    if (index >= 0) layer.SetCell(originX + x, originY + y, MakeTileCell(index, flags));
+                }
+                else if (!json.SkipValue(token)) {
+                    return false;
+                }
+            }
+        }
+        return true;
+    }
+
+    // the v2 flat cell array, either placed directly or collected into pending when the width isn't known yet
+    bool ReadData(Token token, TileLayer& layer, int width, int originX, int originY, std::vector<TileCell>* pending) {
+        if (token == Token::Null) return true;
+        if (token != Token::BeginArray) return false;
+        // once the width is known a partial load only parses the cells inside its area, the rest are stepped over unparsed
+        bool isCropped = load.hasArea && !pending;
+        int firstX = 0, endX = width, firstY = 0, endY = 0;
+        if (isCropped) {
+            firstX = std::max(0, std::min(load.area.left - originX, width));
+            endX = std::max(firstX, std::min(load.area.left + load.area.width - originX, width));
+            firstY = std::max(0, load.area.top - originY);
+            endY = std::max(firstY, load.area.top + load.area.height - originY);
+        }
+        int x = 0, y = 0;
+        for (;;) {
+            if (isCropped && x == 0) {
+                // rows above the area go in one skip, and below it the rest of the array is only scanned for its end
+                if (y >= endY || firstX == endX) return json.SkipValue(Token::BeginArray);
+                if (y < firstY && !json.SkipElements(static_cast<size_t>(firstY - y) * static_cast<size_t>(width))) return false;
+                y = std::max(y, firstY);
+                if (!json.SkipElements(static_cast<size_t>(firstX))) return false;
+                x = firstX;
+            }
+            else if (isCropped && x == endX) {
+                if (!json.SkipElements(static_cast<size_t>(width - endX))) return false;
+                x = 0;
+                ++y;
+                if (!CheckProgress()) return false;
+                continue;
+            }
+            token = json.Next();
+            if (token == Token::EndArray) break;
+            if (token != Token::Number) return false;
+            double value = json.GetNumber();
+            // -1 is accepted as empty as well, the way some exporters mark missing tiles
+            TileCell cell = value > 0 && value <= 4294967295.0 ? static_cast<TileCell>(value) : EmptyCell;
+            if (pending) {
+                pending->push_back(cell);
+                if (pending->size() % 4096 == 0 && !CheckProgress()) return false;
+                continue;
+            }
+            if (cell != EmptyCell) layer.SetCell(originX + x, originY + y, cell);
+            if (++x == width) {
+                x = 0;
+                ++y;
+                if (!CheckProgress()) return false;
+            }
+        }
+        return true;
     }
-    file << mapData.dump(4); // pretty-print json with 4 space indentation for readability 
-    return true;    // return true if saving succeeded
+
+    bool ReadTile(int& index, std::uint32_t& flags) {
+        for (Token token = json.Next(); token != Token::EndObject; token = json.Next()) {
+            if (token != Token::Key) return false;
+            const std::string& key = json.GetText();
+            double value = -1;
+            if (key == "index") {
+                if (!ReadNumber(value)) return false;
+                index = static_cast<int>(value);
+            }
+            else if (key == "flags") {
+                value = 0;
+                if (!ReadNumber(value)) return false;
+                flags = static_cast<std::uint32_t>(value);
+            }
+            else if (!json.SkipValue(json.Next())) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // rebuild a layer with every tile offset by (offsetX, offsetY)
+    static void MoveLayerTiles(TileLayer& layer, int offsetX, int offsetY) {
+        std::unordered_map<std::int64_t, TileChunk> chunks;
+        chunks.swap(layer.chunks);
+        layer.tileBounds = sf::IntRect();
+        for (const auto& entry : chunks) {
+            int startX = GetChunkKeyX(entry.first) * layer.chunkSize;
+            int startY = GetChunkKeyY(entry.first) * layer.chunkSize;
+            for (int localY = 0; localY < layer.chunkSize; ++localY) {
+                for (int localX = 0; localX < layer.chunkSize; ++localX) {
+                    TileCell cell = entry.second.GetCells()[localY * layer.chunkSize + localX];
+                    if (cell != EmptyCell) layer.SetCell(startX + localX + offsetX, startY + localY + offsetY, cell);
+                }
+            }
+        }
+    }
+};
+
+bool TileMap::MapLoad::IsLayerWanted(int fileIndex) const {
+    return layerFilter.empty() || std::find(layerFilter.begin(), layerFilter.end(), fileIndex) != layerFilter.end();
+}
+
+void TileMap::MapLoad::AddLayer(TileLayer&& layer, int fileIndex) {
+    if (hasArea) { layer.CropToArea(area); }
+    std::lock_guard<std::mutex> lock(mutex);
+    fileLayers.push_back(fileIndex);
+    chunkSizes.push_back(layer.chunkSize);
+    finishedLayers.push_back(std::move(layer));
+    ++layerCount;
+}
+
+void TileMap::MapLoad::Finish(bool loaded) {
+    std::lock_guard<std::mutex> lock(mutex);
+    isDone = true;
+    isLoaded = loaded;
+}
+
+void TileMap::ReadMapFile(MapLoad& load) {
+    // the file is mapped rather than read, binary maps use the chunks in place and json is tokenized straight from the mapping
+    std::shared_ptr<MappedFile> mapped = std::make_shared<MappedFile>();
+    if (!mapped->Open(load.filename)) {
+        std::cerr << "Failed to open file for loading: " << load.filename << "\n";
+        load.Finish(false);
+        return;
+    }
+    // binary maps are recognized by their magic bytes rather than the extension, so a renamed file still loads
+    if (HasMapFileMagic(mapped->GetData(), mapped->GetSize())) {
+        load.isBinary = true;
+        bool isRead = ReadBinaryTileMap(mapped, load);
+        if (isRead) { ReadMapJournal(load, *mapped); }  // edits saved incrementally after the file was written are in its journal
+        load.Finish(isRead && !load.isCancelled);
+        return;
+    }
+    JsonReader json(mapped->GetData(), mapped->GetSize());
+    JsonMapReader reader(json, load);
+    bool isRead = reader.ReadMap();
+    if (!isRead && !load.isCancelled) {
+        std::cerr << "Failed to parse tile map " << load.filename << ": " << reader.error << "\n";
+    }
+    load.tileSize = static_cast<int>(reader.tileSize);
+    load.Finish(isRead);
 }
 
 bool TileMap::LoadTileMap(const std::string& filename) {
-    nlohmann::json mapData; // initialize a mapData object which will hold each l
-    // open the file specified during the ui interaction
-    std::ifstream file(filename);
-    if (!file.is_open()) {
-        std::cerr << "Failed to open file for loading: " << filename << "\n";
+    MapLoad load;
+    load.filename = filename;
+    return LoadMap(load);
+}
+
+bool TileMap::LoadTileMapLayers(const std::string& filename, const std::vector<int>& layerIndices) {
+    MapLoad load;
+    load.filename = filename;
+    load.layerFilter = layerIndices;
+    return LoadMap(load);
+}
+
+bool TileMap::LoadTileMapRegion(const std::string& filename, const sf::IntRect& area, const std::vector<int>& layerIndices) {
+    MapLoad load;
+    load.filename = filename;
+    load.layerFilter = layerIndices;
+    load.hasArea = true;
+    load.area = area;
+    return LoadMap(load);
+}
+
+bool TileMap::LoadMap(MapLoad& load) {
+    // a background save of this file may still be writing it, or waiting for a long edit to finish
+    FinishMapTasks();
+    saver.Wait();
+    CancelLoad();
+    // layers are read into the load state so a malformed file leaves the current map untouched
+    load.chunkSize = defaultChunkSize;
+    ReadMapFile(load);
+    if (!load.isLoaded) return false;
+    std::set<int> requested(load.layerFilter.begin(), load.layerFilter.end());
+    if (load.fileLayers.size() != requested.size() && !requested.empty()) {
+        std::cerr << "Tile map " << load.filename << " doesn't have every requested layer\n";
         return false;
     }
-    file >> mapData;    // parse the specified files contents into the mapData object
-    layers.clear(); // clear any existing layers so there are no random layers visible when this map is loaded
-    // iterate over each layer stored in the mapData["layers"] array
-    for (const auto& layerData : mapData["layers"]) {
-        TileLayer newLayer; // create new TileLayer object for each layer (which will be loaded and re-drawn) and populate it with the deserialized data
-        newLayer.width = layerData["width"];
-        newLayer.height = layerData["height"];
-        newLayer.isVisible = layerData["isVisible"];
-        newLayer.opacity = layerData["opacity"];
-        newLayer.index = layers.size(); // set this new layer's index to match it's original index in the layers vector
-        newLayer.layer.resize(newLayer.height, std::vector<Tile>(newLayer.width));  // resize the new layer grid (newLayer.layer) to its width and height
-        // iterate through the "tiles" array from layerData and deserialize each tile
-        const auto& tiles = layerData["tiles"];
-        for (int y = 0; y < newLayer.height; ++y) {
-            for (int x = 0; x < newLayer.width; ++x) {
-                if (tiles[y][x].is_null()) continue; // skip empty tiles
-                const auto& tileData = tiles[y][x]; // set the tileData for the [y][x] tile from the "tiles" array
-                Tile& tile = newLayer.layer[y][x];  // create Tile struct object to hold the [y][x] tile from newLayer.layer (which is the new TileLayer struct's grid of tiles)
-                // set the Tile struct object's attributes based on the deserialized json
-                tile.index = tileData["index"];
-                tile.sprite.setTexture(tileAtlas.GetTexture());
-                tile.sprite.setTextureRect(sf::IntRect(
-                    tileData["textureRect"]["left"],
-                    tileData["textureRect"]["top"],
-                    tileData["textureRect"]["width"],
-                    tileData["textureRect"]["height"]
-                ));
-                tile.sprite.setPosition(
-                    tileData["position"]["x"],
-                    tileData["position"]["y"]
-                );
-                tile.sprite.setScale(layerScaleFactor, layerScaleFactor);
-            }
-        }
-        layers.push_back(newLayer); // push the new layer back into the vector of layers each iteration
+    layers = std::move(load.finishedLayers);
+    CompleteLoad(load);
+    return true;    // return true if loading succeeded
+}
+
+void TileMap::LoadTileMapAsync(const std::string& filename) {
+    FinishMapTasks();
+    saver.Wait();
+    CancelLoad();
+    activeLoad = std::make_shared<MapLoad>();
+    activeLoad->filename = filename;
+    activeLoad->chunkSize = defaultChunkSize;
+    std::shared_ptr<MapLoad> load = activeLoad;
+    loadTasks.Submit("load map", [load] { ReadMapFile(*load); });
+    editor.BeginAnimation();    // redraw every frame while layers arrive and the progress changes
+}
+
+void TileMap::UpdateLoad() {
+    if (!activeLoad) return;
+    std::vector<TileLayer> readLayers;
+    bool isDone;
+    {
+        std::lock_guard<std::mutex> lock(activeLoad->mutex);
+        readLayers.swap(activeLoad->finishedLayers);
+        isDone = activeLoad->isDone;
+    }
+    if (!readLayers.empty()) {
+        // the first read layer replaces the map on screen, the old map is kept aside until the whole file has been read
+        if (!hasStashedMap) {
+            stashedLayers = std::move(layers);
+            stashedActiveLayer = activeLayerIndex;
+            hasStashedMap = true;
+            layers.clear();
+        }
+        for (TileLayer& layer : readLayers) {
+            layer.id = ++layerIdCount;
+            layers.push_back(std::move(layer));
+        }
+        activeLayerIndex = 0;
+        editor.RequestRedraw();
+    }
+    if (!isDone) return;
+    loadTasks.Wait();
+    if (activeLoad->isLoaded) {
+        if (!hasStashedMap) layers.clear(); // the file had no layers at all
+        hasStashedMap = false;
+        stashedLayers.clear();
+        CompleteLoad(*activeLoad);
+        statusMessage = "Loaded " + activeLoad->filename;
+    }
+    else {
+        RestoreStashedMap();
+        statusMessage = "Failed to load " + activeLoad->filename;
+    }
+    activeLoad.reset();
+    editor.EndAnimation();
+}
+
+void TileMap::CancelLoad() {
+    if (!activeLoad) return;
+    activeLoad->isCancelled = true;
+    loadTasks.Wait();   // the reader checks the flag between rows and chunks, so this returns almost straight away
+    RestoreStashedMap();
+    statusMessage = "Cancelled loading " + activeLoad->filename;
+    activeLoad.reset();
+    editor.EndAnimation();
+}
+
+void TileMap::CompleteLoad(MapLoad& load) {
+    if (load.tileSize > 0 && load.tileSize != editor.baseTileSize) {
+        std::cerr << "Tile map " << load.filename << " was saved with " << load.tileSize << " pixel tiles, the editor uses " << editor.baseTileSize << "\n";
     }
+    layoutRevision = ++revision;    // the journals of every other file describe a different map now
+    ReplayMapJournal(load);
+    autosavedRevision = revision;   // a freshly loaded map has nothing to autosave
     activeLayerIndex = layers.empty() ? -1 : 0; // reset active layer
-    return true;    // return true if loading succeeded
-}
\ No newline at end of file
+    // loaded chunks carry no edit revision and the journal may have replaced some after they were shown, new ids make the renderer build every mesh again
+    for (TileLayer& layer : layers) { layer.id = ++layerIdCount; }
+    editor.RequestRedraw();
+}
+
+void TileMap::ReadMapJournal(MapLoad& load, const MappedFile& mapped) {
+    std::string journalFilename = GetMapJournalFilename(load.filename);
+    std::vector<char> data;
+    bool hasJournal = AsyncIO::GetShared().ReadFile(journalFilename, data);
+    load.fileSize = mapped.GetSize();
+    if (!hasJournal) return;    // the map was saved in full, it is hashed if a save starts a journal for it, hashing it here would read every page of the mapping
+    load.fileHash = HashBytes(mapped.GetData(), mapped.GetSize());
+    load.isFileHashed = true;
+    ByteReader in(data.data(), data.size());
+    char magic[sizeof(MapJournalMagic)];
+    in.ReadBytes(magic, sizeof(magic));
+    std::uint16_t version = in.ReadU16();
+    in.ReadU16();
+    std::uint64_t baseSize = in.ReadU64();
+    std::uint64_t baseHash = in.ReadU64();
+    if (in.HasFailed() || std::memcmp(magic, MapJournalMagic, sizeof(magic)) != 0 || version != MapJournalVersion) {
+        std::cerr << "Ignoring unreadable journal " << journalFilename << "\n";
+        return;
+    }
+    if (baseSize != load.fileSize || baseHash != load.fileHash) {
+        std::cerr << "Ignoring journal " << journalFilename << ", it was written for an older save of the map\n";
+        return;
+    }
+    load.journalSize = in.GetPosition();
+    // records are replayed up to the first one that doesn't check out, which is where a crash interrupted a save
+    while (in.GetRemaining() > 0 && !load.isCancelled) {
+        std::uint32_t bodySize = in.ReadU32();
+        std::uint64_t bodyHash = in.ReadU64();
+        if (in.HasFailed() || bodySize > in.GetRemaining() || HashBytes(in.GetCurrent(), bodySize) != bodyHash) {
+            std::cerr << "Journal " << journalFilename << " ends in an incomplete save, the saves before it were recovered\n";
+            return;
+        }
+        ByteReader body(in.GetCurrent(), bodySize);
+        in.Skip(bodySize);
+        body.ReadU64(); // revision the record was saved at
+        std::uint32_t chunkCount = body.ReadU32();
+        std::vector<MapLoad::JournalChunk> chunks;
+        bool isValid = !body.HasFailed();
+        for (std::uint32_t c = 0; c < chunkCount && isValid; ++c) {
+            std::uint32_t layer = body.ReadU32();
+            int x = body.ReadI32();
+            int y = body.ReadI32();
+            std::uint32_t tileCount = body.ReadU32();
+            const TileCodec* codec = GetTileCodec(static_cast<LayerCodec>(body.ReadU8()));
+            std::uint32_t payloadSize = body.ReadU32();
+            const char* payload = body.GetCurrent();
+            if (body.HasFailed() || !codec || !body.Skip(payloadSize)) {
+                isValid = false;
+                break;
+            }
+            // chunks of layers a partial load left out are skipped, the others refer to the layer by its index in the file
+            size_t index = std::find(load.fileLayers.begin(), load.fileLayers.end(), static_cast<int>(layer)) - load.fileLayers.begin();
+            if (index == load.fileLayers.size()) continue;
+            if (load.hasArea) {
+                int chunkSize = load.chunkSizes[index];
+                if (!load.area.intersects(sf::IntRect(x * chunkSize, y * chunkSize, chunkSize, chunkSize))) continue;
+            }
+            size_t cellCount = static_cast<size_t>(load.chunkSizes[index]) * load.chunkSizes[index];
+            MapLoad::JournalChunk chunk{ static_cast<int>(index), MakeChunkKey(x, y), nullptr, static_cast<int>(tileCount) };
+            if (tileCount > 0) {
+                chunk.cells = AllocateCells(cellCount);
+                isValid = tileCount <= cellCount && codec->decode(payload, payloadSize, chunk.cells.get(), cellCount);
+            }
+            chunks.push_back(std::move(chunk));
+        }
+        if (!isValid) {
+            std::cerr << "Corrupt record in journal " << journalFilename << ", the saves before it were recovered\n";
+            return;
+        }
+        for (MapLoad::JournalChunk& chunk : chunks) { load.journalChunks.push_back(std::move(chunk)); }
+        load.journalSize = in.GetPosition();
+    }
+}
+
+void TileMap::ReplayMapJournal(MapLoad& load) {
+    // the chunks are applied in the order they were saved, so a later record wins over an earlier one
+    for (MapLoad::JournalChunk& chunk : load.journalChunks) {
+        TileLayer& layer = layers[chunk.layer];
+        if (chunk.tileCount > 0) {
+            layer.InsertChunk(chunk.key, std::move(chunk.cells), chunk.tileCount);
+        }
+        else {
+            layer.chunks.erase(chunk.key);
+            layer.isBoundsStale = true;
+        }
+    }
+    if (load.hasArea && !load.journalChunks.empty()) {
+        for (TileLayer& layer : layers) { layer.CropToArea(load.area); }
+    }
+    load.journalChunks.clear();
+    if (!load.isBinary || load.IsPartial() || !HasMapFileExtension(load.filename)) return;
+    // saving the map back to the same file appends to the journal that was just replayed
+    std::shared_ptr<MapJournal> journal = std::make_shared<MapJournal>();
+    journal->hasBase = true;
+    journal->revision = revision;
+    journal->baseSize = load.fileSize;
+    journal->baseHash = load.fileHash;
+    journal->isBaseHashed = load.isFileHashed;
+    journal->journalSize = load.journalSize;
+    journals[load.filename] = journal;
+}
+
+void TileMap::RestoreStashedMap() {
+    if (!hasStashedMap) return;
+    layers = std::move(stashedLayers);
+    stashedLayers.clear();
+    activeLayerIndex = stashedActiveLayer;
+    hasStashedMap = false;
+    editor.RequestRedraw();
+}
+
+bool TileMap::WriteBinaryTileMap(const MapSnapshot& snapshot, const std::string& filename, MapJournal* journal, std::atomic<float>& progress) {
+    FileWriter file(filename);
+    if (!file.IsOpen()) {
+        std::cerr << "Failed to open file for saving: " << filename << "\n";
+        if (journal) {
+            std::lock_guard<std::mutex> lock(journal->mutex);
+            journal->hasBase = false;   // a later save must not append to a journal of a file that wasn't written
+        }
+        return false;
+    }
+    // the file is streamed front to back: every layer's payloads go out as they are encoded, its record with the chunk directory after them
+    // and the contents table pointing at the records last, so only a batch of payloads and the directory being built are ever in memory
+    std::uint64_t position = 0;     // file offset of the first byte in buffer
+    ByteHasher hasher;  // the journal's base hash, taken over the bytes on their way out
+    std::vector<char> buffer;
+    ByteWriter out(buffer);
+    auto flush = [&] {
+        hasher.Add(buffer.data(), buffer.size());
+        file.Write(buffer.data(), buffer.size());
+        position += buffer.size();
+        buffer.clear();
+    };
+    auto padToCell = [&] {
+        while ((position + buffer.size()) % sizeof(TileCell) != 0) { out.WriteU8(0); }
+    };
+    out.WriteBytes(MapFileMagic, sizeof(MapFileMagic));
+    out.WriteU16(MapFileVersion);
+    out.WriteU16(0);    // file flags, reserved
+    out.WriteU32(static_cast<std::uint32_t>(snapshot.layers.size()));
+    out.WriteU32(static_cast<std::uint32_t>(snapshot.tileSize));
+    out.WriteU32(static_cast<std::uint32_t>(snapshot.atlasColumns));
+    std::vector<std::uint64_t> layerOffsets;
+    const size_t chunkBatchSize = 1024;    // chunks encoded together, which bounds the payloads held at once
+    for (size_t i = 0; i < snapshot.layers.size(); ++i) {
+        const TileLayer& layer = snapshot.layers[i];
+        size_t cellCount = static_cast<size_t>(layer.chunkSize) * layer.chunkSize;
+        // the directory is sorted by row and then column, which also makes saving the same map twice give identical files
+        std::vector<std::int64_t> keys;
+        keys.reserve(layer.chunks.size());
+        for (const auto& entry : layer.chunks) { keys.push_back(entry.first); }
+        std::sort(keys.begin(), keys.end(), [](std::int64_t a, std::int64_t b) {
+            return GetChunkKeyY(a) != GetChunkKeyY(b) ? GetChunkKeyY(a) < GetChunkKeyY(b) : GetChunkKeyX(a) < GetChunkKeyX(b);
+        });
+        std::vector<const TileCell*> chunkCells;
+        chunkCells.reserve(keys.size());
+        for (std::int64_t key : keys) { chunkCells.push_back(layer.chunks.at(key).GetCells()); }
+        const TileCodec* codec = GetTileCodec(ChooseLayerCodec(snapshot.binaryCompression, chunkCells, cellCount));
+        // each batch of chunks is encoded in parallel into their own buffers, then appended in directory order so the file stays deterministic
+        std::vector<char> directory;
+        ByteWriter directoryOut(directory);
+        std::vector<std::vector<char>> payloads;
+        for (size_t first = 0; first < keys.size(); first += chunkBatchSize) {
+            size_t count = std::min(chunkBatchSize, keys.size() - first);
+            payloads.assign(count, std::vector<char>());
+            ThreadPool::GetShared().ParallelFor("encode chunks", count, [&](size_t c) {
+                ByteWriter payload(payloads[c]);
+                codec->encode(chunkCells[first + c], cellCount, payload);
+            });
+            for (size_t c = 0; c < count; ++c) {
+                std::int64_t key = keys[first + c];
+                padToCell();
+                directoryOut.WriteI32(GetChunkKeyX(key));
+                directoryOut.WriteI32(GetChunkKeyY(key));
+                directoryOut.WriteU32(static_cast<std::uint32_t>(layer.chunks.at(key).tileCount));
+                directoryOut.WriteU32(static_cast<std::uint32_t>(payloads[c].size()));
+                directoryOut.WriteU64(position + buffer.size());
+                out.WriteBytes(payloads[c].data(), payloads[c].size());
+            }
+            flush();    // written while the next batch is encoded
+            progress = (i + static_cast<float>(first + count) / keys.size()) / snapshot.layers.size();
+        }
+        padToCell();
+        layerOffsets.push_back(position + buffer.size());
+        std::uint32_t flags = 0;
+        if (layer.isVisible) flags |= LayerVisible;
+        if (layer.isInfinite) flags |= LayerInfinite;
+        out.WriteU32(flags);
+        out.WriteF32(layer.opacity);
+        out.WriteI32(layer.width);
+        out.WriteI32(layer.height);
+        out.WriteU32(static_cast<std::uint32_t>(layer.chunkSize));
+        out.WriteU8(static_cast<std::uint8_t>(codec->id));
+        for (int pad = 0; pad < 3; ++pad) { out.WriteU8(0); }
+        out.WriteU32(static_cast<std::uint32_t>(keys.size()));
+        out.WriteBytes(directory.data(), directory.size());
+        flush();
+    }
+    for (std::uint64_t offset : layerOffsets) { out.WriteU64(offset); }
+    flush();
+    bool isSaved = file.Finish();
+    if (journal) {
+        // the rewritten file holds every edit, so its old journal goes away, a crash before that leaves a journal whose hash no longer matches
+        if (isSaved) { std::remove(GetMapJournalFilename(filename).c_str()); }
+        std::lock_guard<std::mutex> lock(journal->mutex);
+        journal->hasBase = isSaved;
+        journal->revision = snapshot.revision;
+        journal->baseSize = position;
+        journal->baseHash = isSaved ? hasher.Finish() : 0;
+        journal->isBaseHashed = isSaved;
+        journal->journalSize = 0;
+    }
+    progress = 1.f;
+    return isSaved;
+}
+
+bool TileMap::AppendMapJournal(const MapSnapshot& snapshot, const std::string& filename, MapJournal& journal, std::atomic<float>& progress) {
+    if (!journal.hasBase) {
+        // the full save this one was planned after failed, so the file no longer matches the journal
+        std::cerr << "Failed to save " << filename << " incrementally, the previous save of it failed\n";
+        return false;
+    }
+    // one record holding every chunk edited since the journal's revision, erased chunks are stored without a payload
+    std::vector<char> body;
+    ByteWriter out(body);
+    out.WriteU64(snapshot.revision);
+    size_t countOffset = out.GetSize();
+    out.WriteU32(0);    // chunk count, patched at the end
+    std::uint32_t chunkCount = 0;
+    for (size_t i = 0; i < snapshot.layers.size(); ++i) {
+        const TileLayer& layer = snapshot.layers[i];
+        progress = static_cast<float>(i) / snapshot.layers.size();
+        size_t cellCount = static_cast<size_t>(layer.chunkSize) * layer.chunkSize;
+        // a queued save of this file may already have written some of the captured chunks
+        std::vector<std::int64_t> keys;
+        std::vector<const TileCell*> chunkCells;
+        for (const auto& entry : layer.chunks) {
+            if (entry.second.revision <= journal.revision) continue;
+            keys.push_back(entry.first);
+            chunkCells.push_back(entry.second.GetCells());
+        }
+        const TileCodec* codec = GetTileCodec(ChooseLayerCodec(snapshot.binaryCompression, chunkCells, cellCount));
+        std::vector<std::vector<char>> payloads(keys.size());
+        ThreadPool::GetShared().ParallelFor("encode journal chunks", keys.size(), [&](size_t c) {
+            ByteWriter payload(payloads[c]);
+            codec->encode(chunkCells[c], cellCount, payload);
+        });
+        for (size_t c = 0; c < keys.size(); ++c) {
+            out.WriteU32(static_cast<std::uint32_t>(i));
+            out.WriteI32(GetChunkKeyX(keys[c]));
+            out.WriteI32(GetChunkKeyY(keys[c]));
+            out.WriteU32(static_cast<std::uint32_t>(layer.chunks.at(keys[c]).tileCount));
+            out.WriteU8(static_cast<std::uint8_t>(codec->id));
+            out.WriteU32(static_cast<std::uint32_t>(payloads[c].size()));
+            out.WriteBytes(payloads[c].data(), payloads[c].size());
+            ++chunkCount;
+        }
+        for (const auto& entry : layer.removedChunks) {
+            if (entry.second <= journal.revision) continue;
+            out.WriteU32(static_cast<std::uint32_t>(i));
+            out.WriteI32(GetChunkKeyX(entry.first));
+            out.WriteI32(GetChunkKeyY(entry.first));
+            out.WriteU32(0);
+            out.WriteU8(static_cast<std::uint8_t>(LayerCodec::None));
+            out.WriteU32(0);
+            ++chunkCount;
+        }
+    }
+    if (chunkCount > 0) {
+        out.PatchU32(countOffset, chunkCount);
+        std::vector<char> record;
+        ByteWriter recordOut(record);
+        if (journal.journalSize == 0 && !journal.isBaseHashed && !HashJournalBase(filename, journal)) {
+            std::lock_guard<std::mutex> lock(journal.mutex);
+            journal.hasBase = false;    // the next save rewrites the whole file
+            return false;
+        }
+        if (journal.journalSize == 0) {
+            recordOut.WriteBytes(MapJournalMagic, sizeof(MapJournalMagic));
+            recordOut.WriteU16(MapJournalVersion);
+            recordOut.WriteU16(0);  // flags, reserved
+            recordOut.WriteU64(journal.baseSize);
+            recordOut.WriteU64(journal.baseHash);
+        }
+        recordOut.WriteU32(static_cast<std::uint32_t>(body.size()));
+        recordOut.WriteU64(HashBytes(body.data(), body.size()));
+        recordOut.WriteBytes(body.data(), body.size());
+        // the record goes right after the last good one, which also overwrites what a crash may have left half written there
+        std::string journalFilename = GetMapJournalFilename(filename);
+        size_t recordSize = record.size();
+        FileWriter file(journalFilename, journal.journalSize);  // a journal that is started replaces what an earlier file left behind
+        file.Write(std::make_shared<std::vector<char>>(std::move(record)));
+        bool isWritten = file.Finish();
+        std::lock_guard<std::mutex> lock(journal.mutex);
+        if (!isWritten) {
+            std::cerr << "Failed to append to " << journalFilename << "\n";
+            journal.hasBase = false;    // the next save rewrites the whole file
+            return false;
+        }
+        journal.journalSize += recordSize;
+        journal.revision = snapshot.revision;
+    }
+    else {
+        std::lock_guard<std::mutex> lock(journal.mutex);
+        journal.revision = snapshot.revision;
+    }
+    progress = 1.f;
+    return true;
+}
+
+bool TileMap::HashJournalBase(const std::string& filename, MapJournal& journal) {
+    // the map was loaded without a journal, the file it was loaded from is hashed now that a journal is started for it
+    MappedFile mapped;
+    if (!mapped.Open(filename) || mapped.GetSize() != journal.baseSize) {
+        std::cerr << "Failed to save " << filename << " incrementally, the file changed since it was loaded\n";
+        return false;
+    }
+    std::uint64_t hash = HashBytes(mapped.GetData(), mapped.GetSize());
+    std::lock_guard<std::mutex> lock(journal.mutex);
+    journal.baseHash = hash;
+    journal.isBaseHashed = true;
+    return true;
+}
+
+bool TileMap::ReadBinaryTileMap(const std::shared_ptr<const MappedFile>& file, MapLoad& load) {
+    const std::string& filename = file->GetFilename();
+    const char* data = file->GetData();
+    ByteReader in(data, file->GetSize());
+    in.Skip(sizeof(MapFileMagic));
+    std::uint16_t version = in.ReadU16();
+    in.ReadU16();
+    std::uint32_t layerCount = in.ReadU32();
+    in.ReadU32();   // tile size and atlas columns the map was saved with, cells only store atlas indices so neither is needed here
+    in.ReadU32();
+    if (in.HasFailed() || version < 1 || version > MapFileVersion) {
+        std::cerr << "Unsupported binary tile map version in " << filename << "\n";
+        return false;
+    }
+    std::vector<std::uint64_t> layerOffsets;
+    if (version >= 3) {
+        // the contents table closes the file
+        if (static_cast<std::uint64_t>(layerCount) * 8 > in.GetRemaining()) {
+            std::cerr << "Unexpected end of file in " << filename << "\n";
+            return false;
+        }
+        in.Seek(file->GetSize() - static_cast<size_t>(layerCount) * 8);
+    }
+    if (version >= 2) {
+        for (std::uint32_t i = 0; i < layerCount && !in.HasFailed(); ++i) { layerOffsets.push_back(in.ReadU64()); }
+    }
+    // uncompressed chunks are used in place when the host byte order matches the file, nothing is read until a chunk is touched
+    bool canMapCells = IsLittleEndianHost();
+    // layers are handed to the load state as they are decoded, a corrupt file still leaves the current map untouched
+    for (std::uint32_t i = 0; i < layerCount && !in.HasFailed(); ++i) {
+        // the contents table lets a partial load jump straight to the layers it wants, version 1 has to walk past the others
+        bool isWanted = load.IsLayerWanted(static_cast<int>(i));
+        if (version >= 2 && !isWanted) continue;
+        if (version >= 2) in.Seek(layerOffsets[i]);
+        TileLayer newLayer;
+        std::uint32_t flags = in.ReadU32();
+        newLayer.isVisible = (flags & LayerVisible) != 0;
+        newLayer.isInfinite = (flags & LayerInfinite) != 0;
+        newLayer.opacity = in.ReadF32();
+        newLayer.width = in.ReadI32();
+        newLayer.height = in.ReadI32();
+        newLayer.chunkSize = static_cast<int>(in.ReadU32());
+        const TileCodec* codec = GetTileCodec(static_cast<LayerCodec>(in.ReadU8()));
+        in.Skip(3);
+        std::uint32_t chunkCount = in.ReadU32();
+        newLayer.index = load.layerCount;
+        if (in.HasFailed() || newLayer.chunkSize <= 0 || newLayer.chunkSize > 1024 || !codec
+            || chunkCount > in.GetRemaining() / (version >= 2 ? MapChunkEntrySize : 12)) {
+            std::cerr << "Invalid layer " << i << " in " << filename << "\n";
+            return false;
+        }
+        size_t cellCount = static_cast<size_t>(newLayer.chunkSize) * newLayer.chunkSize;
+        // the directory (or the inline chunk headers of version 1) is walked first, then the payloads are decoded in parallel
+        struct ChunkEntry {
+            int x;
+            int y;
+            int tileCount;  // -1 when the file doesn't store it (version 1), it is counted after decoding
+            const char* payload;
+            std::uint32_t payloadSize;
+            std::shared_ptr<TileCell> cells;
+            bool isMapped;
+            bool isDecoded;
+        };
+        // a region is found by binary searching the sorted directory for each chunk row it covers,
+        // so only the entries and payloads of the chunks overlapping it are ever touched
+        bool isDirectorySearched = load.hasArea && version >= 2;
+        std::vector<std::uint32_t> entryIndices;
+        size_t directoryOffset = in.GetPosition();
+        if (isDirectorySearched && chunkCount > 0 && load.area.width > 0 && load.area.height > 0) {
+            auto GetEntryKey = [&](std::uint32_t c) {
+                ByteReader entry(data + directoryOffset + static_cast<size_t>(c) * MapChunkEntrySize, MapChunkEntrySize);
+                int x = entry.ReadI32();
+                return std::make_pair(entry.ReadI32(), x);  // (y, x), the directory's sort order
+            };
+            int firstX = FloorDiv(load.area.left, newLayer.chunkSize), lastX = FloorDiv(load.area.left + load.area.width - 1, newLayer.chunkSize);
+            int firstY = std::max(FloorDiv(load.area.top, newLayer.chunkSize), GetEntryKey(0).first);
+            int lastY = std::min(FloorDiv(load.area.top + load.area.height - 1, newLayer.chunkSize), GetEntryKey(chunkCount - 1).first);
+            for (int chunkY = firstY; chunkY <= lastY; ++chunkY) {
+                std::uint32_t low = 0, high = chunkCount;
+                while (low < high) {
+                    std::uint32_t middle = low + (high - low) / 2;
+                    if (GetEntryKey(middle) < std::make_pair(chunkY, firstX)) low = middle + 1;
+                    else high = middle;
+                }
+                for (std::uint32_t c = low; c < chunkCount; ++c) {
+                    std::pair<int, int> key = GetEntryKey(c);
+                    if (key.first != chunkY || key.second > lastX) break;
+                    entryIndices.push_back(c);
+                }
+            }
+        }
+        size_t entryCount = isDirectorySearched ? entryIndices.size() : chunkCount;
+        std::vector<ChunkEntry> entries(entryCount);
+        for (size_t c = 0; c < entryCount; ++c) {
+            ChunkEntry& entry = entries[c];
+            if (isDirectorySearched) in.Seek(directoryOffset + static_cast<size_t>(entryIndices[c]) * MapChunkEntrySize);
+            entry.x = in.ReadI32();
+            entry.y = in.ReadI32();
+            entry.payload = nullptr;
+            entry.isMapped = entry.isDecoded = false;
+            if (version >= 2) {
+                entry.tileCount = static_cast<int>(in.ReadU32());
+                entry.payloadSize = in.ReadU32();
+                std::uint64_t payloadOffset = in.ReadU64();
+                bool inFile = !in.HasFailed() && payloadOffset <= file->GetSize() && entry.payloadSize <= file->GetSize() - payloadOffset;
+                if (inFile && entry.tileCount >= 0 && static_cast<size_t>(entry.tileCount) <= cellCount) { entry.payload = data + payloadOffset; }
+            }
+            else {
+                entry.tileCount = -1;
+                entry.payloadSize = in.ReadU32();
+                if (!in.HasFailed() && entry.payloadSize <= in.GetRemaining()) {
+                    entry.payload = in.GetCurrent();
+                    in.Skip(entry.payloadSize);
+                }
+            }
+        }
+        std::atomic<size_t> decodedCount{ 0 };
+        ThreadPool::GetShared().ParallelFor("decode chunks", entryCount, [&](size_t c) {
+            ChunkEntry& entry = entries[c];
+            if (!entry.payload || load.isCancelled) return;
+            if (codec->id == LayerCodec::None && canMapCells && entry.tileCount >= 0 && entry.payloadSize == cellCount * sizeof(TileCell)
+                && (entry.payload - data) % sizeof(TileCell) == 0) {
+                // share ownership of the mapping, it stays mapped for as long as any chunk still points into it
+                entry.cells = std::shared_ptr<TileCell>(file, reinterpret_cast<TileCell*>(const_cast<char*>(entry.payload)));
+                entry.isMapped = entry.isDecoded = true;
+            }
+            else {
+                entry.cells = AllocateCells(cellCount);
+                entry.isDecoded = codec->decode(entry.payload, entry.payloadSize, entry.cells.get(), cellCount);
+                if (entry.isDecoded && entry.tileCount < 0) { entry.tileCount = static_cast<int>(cellCount - std::count(entry.cells.get(), entry.cells.get() + cellCount, EmptyCell)); }
+            }
+            load.progress = (i + static_cast<float>(++decodedCount) / entryCount) / layerCount;
+        });
+        if (load.isCancelled) return false;
+        newLayer.chunks.reserve(entryCount);
+        for (ChunkEntry& entry : entries) {
+            if (!entry.isDecoded) {
+                std::cerr << "Corrupt chunk " << entry.x << ", " << entry.y << " in layer " << i << " of " << filename << "\n";
+                return false;
+            }
+            newLayer.InsertChunk(MakeChunkKey(entry.x, entry.y), std::move(entry.cells), entry.tileCount, entry.isMapped);
+        }
+        if (isWanted) load.AddLayer(std::move(newLayer), static_cast<int>(i));
+    }
+    if (in.HasFailed()) {
+        std::cerr << "Unexpected end of file in " << filename << "\n";
+        return false;
+    }
+    load.mappedFile = file;
+    return true;
+}
@@ -8,23 +8,36 @@
 #include <iostream>
 #include <vector>
 #include <set>
-#include "json.hpp"
+#include <unordered_map>
+#include <cstdint>
+#include <memory>
+#include <atomic>
+#include <mutex>
+#include "tilecell.h"
+#include "tilecodec.h"
+#include "mapsaver.h"
+#include "threadpool.h"
+#include "renderer.h"
+#include "framescheduler.h"
 #include <fstream>
 
 class Editor;
 struct TileAtlas;
+class MappedFile;
 
 class TileMap {
 private:
 	Editor& editor;	// reference to Editor to avoid circular dependency
 	TileAtlas& tileAtlas;
 
-	struct Tile {
-		sf::Sprite sprite;	// sprite for the individual tile
-		int index = -1;  // index in the layer
-		std::vector<sf::IntRect> textureRects; // all tiles' texture regions
-		sf::Texture texture;    // texture of the tile
-		sf::IntRect selectionBounds;    // drag selected area bounds
+	struct TileChunk {
+		std::shared_ptr<TileCell> cells;	// flat row-major grid of chunkSize * chunkSize tile cells, sprites and quads are derived from the atlas when drawing
+		int tileCount = 0;	// number of non-empty cells, the chunk is reclaimed as soon as this drops back to zero
+		bool isReadOnly = false;	// cells point straight into a mapped map file or are shared with a save snapshot or render frame, they are copied before the first edit
+		std::uint64_t revision = 0;	// map revision of the last edit, incremental saves append the chunks edited since the file was last written
+
+		const TileCell* GetCells() const { return cells.get(); }
+		TileCell* GetWritableCells(size_t count);
 	};
 
 	struct TileLayer {
@@ -34,40 +47,195 @@ private:
 		bool isVisible;	// controls visibility of a entire layer, used for merging layers and hiding some specifically
 		float opacity = 0.5f;	// controls the opacity of a layer, used during merge layers to make sure the active layer is opaque
 		int index;	// the index of a tile layer, to access a layer specifically when they're combined into a game map
-		std::vector<std::vector<Tile>> layer;	// 2D grid of tiles makes up an entire layer
+		std::uint64_t id = 0;	// unique for every layer put on screen, the renderer caches chunk meshes per id
+		int chunkSize = 32;	// width and height of a chunk in tiles
+		bool isInfinite = false;	// infinite layers ignore width/height and grow in any direction (including negative coordinates) as tiles are painted
+		mutable sf::IntRect tileBounds;	// smallest rect containing every tile, grown as tiles are written so saving never scans empty space
+		mutable bool isBoundsStale = false;	// set when a tile on the edge of tileBounds is erased, the bounds are then recomputed from the chunks on request
+		std::unordered_map<std::int64_t, TileChunk> chunks;	// sparse storage, a chunk only exists once a tile has been written into it
+		std::unordered_map<std::int64_t, std::uint64_t> removedChunks;	// chunks whose last tile was erased, with the revision of the erase, so incremental saves can record them
 		std::set<sf::Vector2i> selectedTiles;
+
+		TileCell GetCell(int x, int y) const;
+		bool SetCell(int x, int y, TileCell cell);
+		// bulk write of a rect, chunk by chunk: stride 0 repeats cells[0] over the area (an empty cell erases it), otherwise cells is a row-major stamp
+		// stride cells wide whose empty cells leave the layer as it is. every chunk that changed is stamped with revision, returns whether any did
+		bool WriteArea(const sf::IntRect& area, const TileCell* cells, int stride, std::uint64_t revision);
+		void IncludeInBounds(const sf::IntRect& rect);	// grows tileBounds to cover rect
+		std::int64_t GetChunkKey(int x, int y) const;
+		sf::IntRect GetTileBounds() const;
+		bool Contains(int x, int y) const { return isInfinite || (x >= 0 && x < width && y >= 0 && y < height); }
+		void InsertChunk(std::int64_t key, std::shared_ptr<TileCell> cells, int tileCount, bool isReadOnly = false);
+		void StampChunk(std::int64_t key, std::uint64_t revision);	// records an edit of the chunk for incremental saves, whether it still exists or was just erased
+		void CropToArea(const sf::IntRect& area);	// drops every tile outside area, used by partial loads
+		std::vector<TileCell> CopyArea(const sf::IntRect& area) const;
+	};
+
+	struct JsonMapReader;	// sax handler that fills layers while a json map is parsed
+
+	// everything a save writes, captured on the main thread so the file can be written on the saver's worker thread
+	struct MapSnapshot {
+		std::vector<TileLayer> layers;	// the chunks share their cells with the live layers, an edit copies a shared chunk before writing to it
+		std::uint64_t revision;	// map revision the snapshot was taken at
+		bool isIncremental;	// only the chunks edited since the journal's revision were captured, the rest of the map is already in the file
+		int tileSize;
+		std::string atlasPath;
+		int atlasColumns;
+		bool prettyPrintJson;
+		CodecPreference binaryCompression;
+		CodecPreference jsonCompression;
+	};
+
+	// incremental save state of one .tmb file, updated by the save writing the file and read by the main thread to plan the next save
+	struct MapJournal {
+		mutable std::mutex mutex;	// guards the fields below, only the saver's thread writes them
+		bool hasBase = false;	// the file was written in full or loaded, so it holds the map as of revision together with its journal
+		std::uint64_t revision = 0;	// map revision the file and its journal hold, chunks edited after it are appended by the next incremental save
+		std::uint64_t baseSize = 0;	// size and hash of the .tmb the journal applies to, a journal left beside a different file is never replayed
+		std::uint64_t baseHash = 0;
+		bool isBaseHashed = false;	// a map loaded without a journal is only hashed once the first incremental save starts one
+		std::uint64_t journalSize = 0;	// bytes in the journal file, 0 when there is none yet
+	};
+
+	// state shared by the main thread and the thread reading a map, the reader hands over each layer as soon as it is complete
+	struct MapLoad {
+		std::string filename;
+		int chunkSize = 32;	// chunk size given to layers read from json
+		std::vector<int> layerFilter;	// file indices of the layers to read, empty reads every layer
+		bool hasArea = false;	// only the tiles inside area are read, binary maps only decode the chunks overlapping it and json steps over the rows around it unparsed
+		sf::IntRect area;
+		std::atomic<bool> isCancelled{ false };	// checked by the reader between rows and chunks
+		std::atomic<float> progress{ 0.f };
+		int layerCount = 0;	// layers read so far, only used by the reader
+		std::mutex mutex;	// guards everything below
+		std::vector<TileLayer> finishedLayers;	// read layers the main thread hasn't taken yet
+		bool isDone = false;
+		bool isLoaded = false;	// whether the whole file was read, set together with isDone
+		int tileSize = 0;	// tile size the map was saved with, 0 when the file doesn't say
+		std::shared_ptr<const MappedFile> mappedFile;	// the mapping of a binary map, its chunks may point into it
+		std::vector<int> fileLayers;	// index in the file of every read layer, journal chunks refer to layers by it
+		std::vector<int> chunkSizes;	// chunk size of every read layer, the journal's chunks are decoded with it
+		bool isBinary = false;
+		std::uint64_t fileSize = 0;	// size and hash of a binary map, its journal is only replayed if it was written for this exact file
+		std::uint64_t fileHash = 0;
+		bool isFileHashed = false;	// only maps that have a journal are hashed while loading
+		struct JournalChunk {
+			int layer;
+			std::int64_t key;
+			std::shared_ptr<TileCell> cells;
+			int tileCount;	// 0 when the chunk was erased
+		};
+		std::vector<JournalChunk> journalChunks;	// chunks saved incrementally after the file was written, replayed over the read layers in order
+		std::uint64_t journalSize = 0;	// bytes of the journal that were replayed, the next incremental save appends after them
+
+		bool IsPartial() const { return hasArea || !layerFilter.empty(); }
+		bool IsLayerWanted(int fileIndex) const;
+		void AddLayer(TileLayer&& layer, int fileIndex);
+		void Finish(bool loaded);
 	};
 
 	std::vector<TileLayer> layers;	// vector to hold multiple layers
 	int activeLayerIndex = -1;	// the index of the current active layer, defaulted to -1, used for setting the active/current layer based on index
-	float layerTileSize = 16.0f;	// base tile size (e.g. 16x16)
-	float layerScaleFactor = 1.0f;	// default scale factor for zooming
+	int defaultChunkSize = 32;	// chunk size given to new layers, 32x32 tiles
+	int compositeChunkSize = 32;	// width and height in tiles of the chunks the renderer bakes the merged view into
+	std::uint64_t layerIdCount = 0;	// last id given to a layer
+	MapSaver saver;	// writes saves and autosaves in the background
+	std::string statusMessage;	// outcome of the last finished save or load, shown by the ui
+	std::uint64_t revision = 0;	// bumped by every edit, an autosave is due once it differs from autosavedRevision
+	std::uint64_t autosavedRevision = 0;
+	std::uint64_t layoutRevision = 0;	// revision of the last change a journal can't record (layers added or hidden, a map loaded), the next save of any file is a full one
+	std::unordered_map<std::string, std::shared_ptr<MapJournal>> journals;	// incremental save state of the .tmb files written or loaded this session
+	sf::Clock autosaveClock;	// time since the last autosave started
+	bool isSaveAnimating = false;	// the editor keeps redrawing while a save is in flight so its progress stays up to date
+	std::shared_ptr<MapLoad> activeLoad;	// background load in progress, null when none is running
+	TaskGroup loadTasks;	// reads activeLoad on the thread pool
+	std::vector<TileLayer> stashedLayers;	// the map from before a background load, put back if the load is cancelled or fails
+	int stashedActiveLayer = -1;
+	bool hasStashedMap = false;	// the first loaded layer replaced the map on screen, which now lives in stashedLayers
+	std::vector<FrameScheduler::TaskId> mapTasks;	// long edits running a slice per frame, finished before a load replaces the layers they work on
+	bool isFillingRect = false;	// a rect fill is being dragged on the layer view, it is written when the button is released
+	bool isErasingRect = false;
+	sf::Vector2i fillStart;	// tile the drag started on and the tile under the cursor
+	sf::Vector2i fillEnd;
+
+	void CaptureLayer(TileLayer& layer, const sf::IntRect& area, sf::Uint8 alpha, RenderFrame::Layer& captured);
+	sf::IntRect GetVisibleTiles(const sf::View& view) const;
+	sf::IntRect GetVisibleTiles(const sf::View& view, const TileLayer& layer) const;
+	std::shared_ptr<const MapSnapshot> CreateSnapshot(bool isIncremental, std::uint64_t journalRevision);
+	MapSaver::SaveJob CreateSaveJob(const std::string& filename);
+	bool CanAppendToJournal(const MapJournal& journal) const;	// the caller holds journal.mutex
+	void PruneRemovedChunks();	// drops the erase records every journal already holds, after a save completed
+	void StartSave(const std::string& filename, bool isAutosave);
+	static bool WriteTileMap(const MapSnapshot& snapshot, const std::string& filename, MapJournal* journal, std::atomic<float>& progress);
+	static bool WriteBinaryTileMap(const MapSnapshot& snapshot, const std::string& filename, MapJournal* journal, std::atomic<float>& progress);
+	static bool AppendMapJournal(const MapSnapshot& snapshot, const std::string& filename, MapJournal& journal, std::atomic<float>& progress);
+	static bool HashJournalBase(const std::string& filename, MapJournal& journal);
+	static void ReadMapFile(MapLoad& load);
+	static bool ReadBinaryTileMap(const std::shared_ptr<const MappedFile>& file, MapLoad& load);
+	static void ReadMapJournal(MapLoad& load, const MappedFile& file);
+	void ReplayMapJournal(MapLoad& load);
+	bool LoadMap(MapLoad& load);
+	void CompleteLoad(MapLoad& load);
+	void RestoreStashedMap();
+	TileLayer* FindLayer(std::uint64_t id);	// layers are found again by id in every slice of a long edit, the vector may have changed in between
+	void StartMapTask(FrameScheduler::TaskId id);
+	void FinishMapTasks();
+	sf::IntRect GetFillRect() const;	// tiles covered by the rect fill being dragged
+	static std::shared_ptr<TileCell> AllocateCells(size_t count);
 
 public:
 	// public variables
 	bool showMergedLayers = false;	// bool to decide whether to display merged layers or not
+	bool prettyPrintJson = true;	// indent saved json maps for readability and diffing, turning it off gives smaller files
+	CodecPreference binaryCompression = CodecPreference::Balanced;	// codec choice for .tmb layers, Fastest keeps them usable straight from the mapped file
+	CodecPreference jsonCompression = CodecPreference::Fastest;	// codec choice for json layers, Fastest keeps the data a plain readable array
+	float autosaveInterval = 120.f;	// seconds between autosaves of an edited map, 0 turns autosave off
+	std::string autosaveFilename = "autosave.tmb";	// autosaves never overwrite the file the user saved to
+	float journalCompactionRatio = 0.5f;	// .tmb saves only append edited chunks to a journal until it grows past this fraction of the file, 0 always rewrites the file
+	size_t maxDirectFillCells = 1 << 22;	// fills covering more cells than this, on fixed and infinite layers alike, are written a band of chunks per frame instead of at once
 	// main tileMap functions
 	TileMap(Editor& editor, TileAtlas& tileAtlas);
+	~TileMap();
 	void Initialize(int width, int height);
-	void DrawLayerGrid(sf::RenderTarget& target, int index);
+	void AddToFrame(RenderFrame& frame);	// captures the visible chunks of the active layer, and of the merged layers when they are shown
 	void SetCurrentLayer(int index);
-	void AddTile(const sf::Texture& texture, const sf::IntRect& rect, int index, int x, int y);
+	void AddTile(TileCell cell, int x, int y);
 	void RemoveTile(int x, int y);
+	void FillRegion(const sf::IntRect& area, TileCell cell);	// sets every cell of the area on the active layer, EmptyCell erases it
+	void PlaceStamp(const std::vector<TileCell>& cells, int width, int x, int y);	// writes a row-major block of cells with its top left at x, y, its empty cells are skipped
 	void HandleTilePlacement(const sf::Vector2f& mousePos);
-	void HandlePanning(sf::Vector2f mousePos, bool isPanning, float deltaTime);
-	void UpdateTileScale(float scaleFactor);
+	void HandleRectFill(const sf::Vector2f& mousePos, bool isDragging, bool isErasing);	// drag with shift held, fills the rect with the selected tile or erases it on release
+	bool IsFillingRect() const { return isFillingRect; }
+	bool IsRectFillButton(sf::Mouse::Button button) const { return button == (isErasingRect ? sf::Mouse::Right : sf::Mouse::Left); }	// only releasing the button that started the rect ends it
+	void HandleTileRemoval(const sf::Vector2f& mousePos);
+	void HandlePanning(sf::Vector2i mousePos, bool isPanning, float deltaTime);
 	void ToggleVisibility();
-	void ClearLayer();
+	void ClearLayer();	// erases the active layer a few chunks per frame, the ui shows how far it got, nothing binds it since there is no undo
 	void ResizeLayer(int newWidth, int newHeight, int tileSize);
-	void AddLayer(int width, int height);
+	void AddLayer(int width, int height, bool isInfinite = false);
 	void RemoveLayer(int index);
-	void MergeAllLayers(sf::RenderTarget& target, bool showMergedLayers);
-	void Render(sf::RenderTarget& target);
-	bool SaveTileMap(const std::string& filename) const;
+	bool SaveTileMap(const std::string& filename);
 	bool LoadTileMap(const std::string& filename);
+	// partial loads for tools that need only part of a map, the layers keep their file order and partial maps never append to the file's journal
+	bool LoadTileMapLayers(const std::string& filename, const std::vector<int>& layerIndices);	// reads only the layers with the given indices in the file
+	bool LoadTileMapRegion(const std::string& filename, const sf::IntRect& area, const std::vector<int>& layerIndices = {});	// reads only the tiles inside area, of every layer or the given ones
+	void SaveTileMapAsync(const std::string& filename);	// returns straight away, the map is written on the saver's thread
+	void LoadTileMapAsync(const std::string& filename);	// reads the map on a worker thread, its layers appear as they are read
+	void CancelLoad();	// stops a background load and puts the previous map back
+	void UpdateSaves();	// called once per frame, collects finished saves and starts autosaves
+	void UpdateLoad();	// called once per frame, shows newly read layers and finishes a background load
+	void WaitForSaves() { saver.Wait(); }
+	bool IsAutosavePending() const { return autosaveInterval > 0.f && revision != autosavedRevision && !activeLoad; }
+	sf::Time GetTimeUntilAutosave() const { return sf::seconds(autosaveInterval) - autosaveClock.getElapsedTime(); }	// negative once it is overdue
+	bool IsLoading() const { return activeLoad != nullptr; }
+	std::string GetStatus() const;
 	// getter functions
-	int GetTileSize() const { return layerTileSize; }
 	int GetCurrentLayerIndex() const { return activeLayerIndex; }
+	// chunk keys pack the signed chunk coordinates into one 64 bit integer for the chunk hash maps
+	static std::int64_t MakeChunkKey(int chunkX, int chunkY) { return (static_cast<std::int64_t>(chunkY) << 32) | static_cast<std::uint32_t>(chunkX); }
+	static int GetChunkKeyX(std::int64_t key) { return static_cast<std::int32_t>(static_cast<std::uint32_t>(key & 0xFFFFFFFF)); }
+	static int GetChunkKeyY(std::int64_t key) { return static_cast<std::int32_t>(key >> 32); }
+	static int FloorDiv(int value, int divisor) { return value >= 0 ? value / divisor : -((-value + divisor - 1) / divisor); }
 	std::vector<TileLayer>& GetLayers() { return layers; }
 };
 #endif
\ No newline at end of file
@@ -0,0 +1,196 @@
+#include "mapformat.h"
+
+bool IsLittleEndianHost() {
+    const std::uint32_t probe = 1;
+    char first;
+    std::memcpy(&first, &probe, 1);
+    return first == 1;
+}
+
+bool HasMapFileMagic(const char* data, size_t size) {
+    return size >= sizeof(MapFileMagic) && std::memcmp(data, MapFileMagic, sizeof(MapFileMagic)) == 0;
+}
+
+bool HasMapFileExtension(const std::string& filename) {
+    return filename.size() >= 4 && filename.compare(filename.size() - 4, 4, ".tmb") == 0;
+}
+
+std::string GetMapJournalFilename(const std::string& mapFilename) {
+    return mapFilename + ".journal";
+}
+
+static const std::uint64_t HashPrime = 1099511628211ull;
+
+static std::uint64_t HashWord(std::uint64_t hash, const unsigned char* bytes) {
+    std::uint64_t word = 0;
+    for (int b = 7; b >= 0; --b) { word = (word << 8) | bytes[b]; }
+    return (hash ^ word) * HashPrime;
+}
+
+std::uint64_t HashBytes(const char* data, size_t size) {
+    ByteHasher hasher;
+    hasher.Add(data, size);
+    return hasher.Finish();
+}
+
+void ByteHasher::Add(const char* data, size_t size) {
+    // fnv-1a over little-endian 8 byte words, so hashing a whole map file runs at memory speed
+    const unsigned char* bytes = reinterpret_cast<const unsigned char*>(data);
+    size_t i = 0;
+    if (pendingSize > 0) {
+        for (; i < size && pendingSize < 8; ++i) { pending[pendingSize++] = bytes[i]; }
+        if (pendingSize < 8) return;
+        hash = HashWord(hash, pending);
+        pendingSize = 0;
+    }
+    for (; i + 8 <= size; i += 8) { hash = HashWord(hash, bytes + i); }
+    for (; i < size; ++i) { pending[pendingSize++] = bytes[i]; }
+}
+
+std::uint64_t ByteHasher::Finish() const {
+    // the bytes after the last whole word are mixed in one at a time
+    std::uint64_t result = hash;
+    for (size_t i = 0; i < pendingSize; ++i) { result = (result ^ pending[i]) * HashPrime; }
+    return result;
+}
+
+void ByteWriter::WriteBytes(const void* data, size_t size) {
+    const char* bytes = static_cast<const char*>(data);
+    buffer.insert(buffer.end(), bytes, bytes + size);
+}
+
+void ByteWriter::WriteU16(std::uint16_t value) {
+    char bytes[2] = { static_cast<char>(value & 0xFF), static_cast<char>(value >> 8) };
+    WriteBytes(bytes, 2);
+}
+
+void ByteWriter::WriteU32(std::uint32_t value) {
+    char bytes[4] = {
+        static_cast<char>(value & 0xFF), static_cast<char>((value >> 8) & 0xFF),
+        static_cast<char>((value >> 16) & 0xFF), static_cast<char>(value >> 24)
+    };
+    WriteBytes(bytes, 4);
+}
+
+void ByteWriter::WriteU64(std::uint64_t value) {
+    WriteU32(static_cast<std::uint32_t>(value & 0xFFFFFFFF));
+    WriteU32(static_cast<std::uint32_t>(value >> 32));
+}
+
+void ByteWriter::WriteVarint(std::uint32_t value) {
+    while (value >= 0x80) {
+        WriteU8(static_cast<std::uint8_t>(value | 0x80));
+        value >>= 7;
+    }
+    WriteU8(static_cast<std::uint8_t>(value));
+}
+
+void ByteWriter::WritePadding(size_t alignment) {
+    buffer.resize((buffer.size() + alignment - 1) / alignment * alignment, 0);
+}
+
+void ByteWriter::WriteF32(float value) {
+    std::uint32_t bits;
+    std::memcpy(&bits, &value, 4);
+    WriteU32(bits);
+}
+
+void ByteWriter::WriteCells(const TileCell* cells, size_t count) {
+    // on little-endian machines the in-memory cells already are the file layout, so the whole array is copied at once
+    if (IsLittleEndianHost()) {
+        WriteBytes(cells, count * sizeof(TileCell));
+        return;
+    }
+    for (size_t i = 0; i < count; ++i) { WriteU32(cells[i]); }
+}
+
+void ByteWriter::PatchU32(size_t offset, std::uint32_t value) {
+    for (int i = 0; i < 4; ++i) { buffer[offset + i] = static_cast<char>((value >> (i * 8)) & 0xFF); }
+}
+
+void ByteWriter::PatchU64(size_t offset, std::uint64_t value) {
+    PatchU32(offset, static_cast<std::uint32_t>(value & 0xFFFFFFFF));
+    PatchU32(offset + 4, static_cast<std::uint32_t>(value >> 32));
+}
+
+bool ByteReader::ReadBytes(void* out, size_t count) {
+    if (failed || count > size - position) {
+        failed = true;
+        return false;
+    }
+    std::memcpy(out, data + position, count);
+    position += count;
+    return true;
+}
+
+std::uint8_t ByteReader::ReadU8() {
+    unsigned char value = 0;
+    ReadBytes(&value, 1);
+    return value;
+}
+
+std::uint16_t ByteReader::ReadU16() {
+    unsigned char bytes[2] = { 0, 0 };
+    ReadBytes(bytes, 2);
+    return static_cast<std::uint16_t>(bytes[0] | (bytes[1] << 8));
+}
+
+std::uint32_t ByteReader::ReadU32() {
+    unsigned char bytes[4] = { 0, 0, 0, 0 };
+    ReadBytes(bytes, 4);
+    return static_cast<std::uint32_t>(bytes[0]) | (static_cast<std::uint32_t>(bytes[1]) << 8) |
+        (static_cast<std::uint32_t>(bytes[2]) << 16) | (static_cast<std::uint32_t>(bytes[3]) << 24);
+}
+
+std::uint64_t ByteReader::ReadU64() {
+    std::uint64_t low = ReadU32();
+    std::uint64_t high = ReadU32();
+    return low | (high << 32);
+}
+
+std::uint32_t ByteReader::ReadVarint() {
+    std::uint32_t value = 0;
+    for (int shift = 0; shift < 35; shift += 7) {
+        std::uint8_t byte = ReadU8();
+        value |= static_cast<std::uint32_t>(byte & 0x7F) << shift;
+        if (!(byte & 0x80)) return value;
+    }
+    failed = true;  // more than 5 bytes can't be a 32 bit value
+    return 0;
+}
+
+float ByteReader::ReadF32() {
+    std::uint32_t bits = ReadU32();
+    float value;
+    std::memcpy(&value, &bits, 4);
+    return value;
+}
+
+bool ByteReader::ReadCells(TileCell* cells, size_t count) {
+    if (failed || count > (size - position) / sizeof(TileCell)) {
+        failed = true;
+        return false;
+    }
+    // straight copy on little-endian machines, byte by byte otherwise
+    if (IsLittleEndianHost()) { return ReadBytes(cells, count * sizeof(TileCell)); }
+    for (size_t i = 0; i < count; ++i) { cells[i] = ReadU32(); }
+    return !failed;
+}
+
+bool ByteReader::Skip(size_t count) {
+    if (failed || count > size - position) {
+        failed = true;
+        return false;
+    }
+    position += count;
+    return true;
+}
+
+bool ByteReader::Seek(std::uint64_t offset) {
+    if (failed || offset > size) {
+        failed = true;
+        return false;
+    }
+    position = static_cast<size_t>(offset);
+    return true;
+}
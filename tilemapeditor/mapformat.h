@@ -0,0 +1,108 @@
+#ifndef MAPFORMAT_H
+#define MAPFORMAT_H
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+#include "tilecell.h"
+
+/*  binary tile map format (.tmb), every value is stored little-endian:
+    file     = header, then per layer its chunk payloads followed by its layer record, then the contents
+    header   = magic "TMB\x1A", u16 version, u16 flags, u32 layer count, u32 tile size, u32 atlas columns
+    layer    = u32 flags, f32 opacity, i32 width, i32 height, u32 chunk size, u8 codec, 3 reserved bytes, u32 chunk count,
+               followed by one directory entry per chunk, sorted by chunk y and then chunk x, so a region is found by binary search
+    entry    = i32 chunk x, i32 chunk y, u32 tile count, u32 payload size, u64 payload offset
+    contents = u64 file offset of each layer record, so any layer is found without reading the ones before it
+    a payload holds chunk size * chunk size cells in row-major order, encoded with the layer's codec (see tilecodec.h)
+    payloads start on a 4 byte boundary, so uncompressed cells can be used in place from a mapped file
+    every offset is known by the time it is written, so a save streams the file front to back without holding it in memory
+    version 2 files have the contents right after the header and every layer record before its payloads
+    version 1 files have no contents table, their chunks are stored inline after the layer record as i32 chunk x, i32 chunk y, u32 payload size, payload
+*/
+
+/*  edit journal (<map>.tmb.journal), appended by incremental saves and replayed over the .tmb when it is loaded:
+    header = magic "TMJ\x1A", u16 version, u16 flags, u64 size and u64 hash of the .tmb it applies to
+    record = u32 body size, u64 hash of the body, body
+    body   = u64 map revision, u32 chunk count, then per chunk u32 layer, i32 chunk x, i32 chunk y, u32 tile count, u8 codec, u32 payload size, payload
+    each record holds every chunk edited since the previous one, a chunk with a tile count of 0 has no payload and was erased
+    a record cut short by a crash fails its hash, replaying stops there and the next save overwrites it
+*/
+
+const char MapFileMagic[4] = { 'T', 'M', 'B', '\x1A' };
+const std::uint16_t MapFileVersion = 3;
+const size_t MapFileHeaderSize = 20;
+const size_t MapChunkEntrySize = 24;
+const char MapJournalMagic[4] = { 'T', 'M', 'J', '\x1A' };
+const std::uint16_t MapJournalVersion = 1;
+
+enum MapLayerFlags : std::uint32_t {
+    LayerVisible = 1u << 0,
+    LayerInfinite = 1u << 1
+};
+
+bool IsLittleEndianHost();
+bool HasMapFileMagic(const char* data, size_t size);
+bool HasMapFileExtension(const std::string& filename);  // .tmb files are saved in the binary format
+std::string GetMapJournalFilename(const std::string& mapFilename);
+std::uint64_t HashBytes(const char* data, size_t size);  // fingerprint of a file or journal record, not meant to resist tampering
+
+// HashBytes over bytes that arrive in pieces, e.g. a file while it is written, gives the same hash as a single call over all of them
+class ByteHasher {
+private:
+    std::uint64_t hash = 14695981039346656037ull;
+    unsigned char pending[8];   // start of a word that isn't complete yet
+    size_t pendingSize = 0;
+public:
+    void Add(const char* data, size_t size);
+    std::uint64_t Finish() const;
+};
+
+// appends little-endian values to a byte buffer
+class ByteWriter {
+private:
+    std::vector<char>& buffer;
+public:
+    ByteWriter(std::vector<char>& buffer) : buffer(buffer) {}
+    void WriteBytes(const void* data, size_t size);
+    void WriteU8(std::uint8_t value) { buffer.push_back(static_cast<char>(value)); }
+    void WriteU16(std::uint16_t value);
+    void WriteU32(std::uint32_t value);
+    void WriteI32(std::int32_t value) { WriteU32(static_cast<std::uint32_t>(value)); }
+    void WriteU64(std::uint64_t value);
+    void WriteVarint(std::uint32_t value);  // 7 bits per byte, small values take a single byte
+    void WriteF32(float value);
+    void WritePadding(size_t alignment);    // zero bytes up to the next multiple of alignment
+    void WriteCells(const TileCell* cells, size_t count);
+    void PatchU32(size_t offset, std::uint32_t value);  // overwrite a value written earlier, e.g. a size only known afterwards
+    void PatchU64(size_t offset, std::uint64_t value);
+    size_t GetSize() const { return buffer.size(); }
+};
+
+// reads little-endian values from a byte range, any read past the end sets the failed flag instead of reading out of bounds
+class ByteReader {
+private:
+    const char* data;
+    size_t size;
+    size_t position = 0;
+    bool failed = false;
+public:
+    ByteReader(const char* data, size_t size) : data(data), size(size) {}
+    bool ReadBytes(void* out, size_t count);
+    std::uint8_t ReadU8();
+    std::uint16_t ReadU16();
+    std::uint32_t ReadU32();
+    std::int32_t ReadI32() { return static_cast<std::int32_t>(ReadU32()); }
+    std::uint64_t ReadU64();
+    std::uint32_t ReadVarint();
+    float ReadF32();
+    bool ReadCells(TileCell* cells, size_t count);
+    bool Skip(size_t count);
+    bool Seek(std::uint64_t offset);
+    const char* GetCurrent() const { return data + position; }
+    size_t GetPosition() const { return position; }
+    size_t GetRemaining() const { return size - position; }
+    bool HasFailed() const { return failed; }
+};
+
+#endif
\ No newline at end of file
@@ -0,0 +1,77 @@
+#include "mappedfile.h"
+#include <iostream>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+bool MappedFile::Open(const std::string& path) {
+    Close();
+#ifdef _WIN32
+    // FILE_SHARE_DELETE lets saves and other programs rename or replace the file while it is mapped
+    HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE) return false;
+    LARGE_INTEGER fileSize;
+    if (!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0) {
+        CloseHandle(file);
+        return false;
+    }
+    HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (!mapping) {
+        std::cerr << "Failed to create file mapping for: " << path << "\n";
+        CloseHandle(file);
+        return false;
+    }
+    const void* view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    if (!view) {
+        std::cerr << "Failed to map file: " << path << "\n";
+        CloseHandle(mapping);
+        CloseHandle(file);
+        return false;
+    }
+    fileHandle = file;
+    mappingHandle = mapping;
+    data = static_cast<const char*>(view);
+    size = static_cast<size_t>(fileSize.QuadPart);
+#else
+    int descriptor = open(path.c_str(), O_RDONLY);
+    if (descriptor < 0) return false;
+    struct stat status;
+    if (fstat(descriptor, &status) != 0 || status.st_size == 0) {
+        close(descriptor);
+        return false;
+    }
+    void* view = mmap(nullptr, static_cast<size_t>(status.st_size), PROT_READ, MAP_PRIVATE, descriptor, 0);
+    close(descriptor);  // the mapping stays valid after the descriptor is closed
+    if (view == MAP_FAILED) {
+        std::cerr << "Failed to map file: " << path << "\n";
+        return false;
+    }
+    data = static_cast<const char*>(view);
+    size = static_cast<size_t>(status.st_size);
+#endif
+    filename = path;
+    return true;
+}
+
+void MappedFile::Close() {
+    if (!data) return;
+#ifdef _WIN32
+    UnmapViewOfFile(data);
+    CloseHandle(static_cast<HANDLE>(mappingHandle));
+    CloseHandle(static_cast<HANDLE>(fileHandle));
+    mappingHandle = fileHandle = nullptr;
+#else
+    munmap(const_cast<char*>(data), size);
+#endif
+    data = nullptr;
+    size = 0;
+    filename.clear();
+}
\ No newline at end of file
@@ -0,0 +1,30 @@
+#ifndef MAPPEDFILE_H
+#define MAPPEDFILE_H
+
+#include <cstddef>
+#include <string>
+
+// read-only view of a whole file mapped into memory, pages are only read from disk when they are first touched
+class MappedFile {
+private:
+    const char* data = nullptr;
+    size_t size = 0;
+    std::string filename;
+#ifdef _WIN32
+    void* fileHandle = nullptr;     // HANDLE of the opened file
+    void* mappingHandle = nullptr;  // HANDLE of the file mapping object
+#endif
+public:
+    MappedFile() = default;
+    ~MappedFile() { Close(); }
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    bool Open(const std::string& filename);
+    void Close();
+    bool IsOpen() const { return data != nullptr; }
+    const char* GetData() const { return data; }
+    size_t GetSize() const { return size; }
+    const std::string& GetFilename() const { return filename; }
+};
+#endif
\ No newline at end of file
@@ -0,0 +1,67 @@
+#include "mapsaver.h"
+
+MapSaver::~MapSaver() {
+    // queued saves are still written before the saver goes away, closing the editor never loses a save it already accepted
+    drainTasks.Wait();
+}
+
+void MapSaver::Enqueue(const std::string& filename, bool isAutosave, SaveJob job) {
+    bool isStarting = false;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        // a save of the same file that hasn't started yet is replaced, the newer snapshot already contains its changes
+        bool isReplaced = false;
+        for (Task& task : tasks) {
+            if (task.filename == filename) {
+                task.job = std::move(job);
+                task.isAutosave = isAutosave;
+                isReplaced = true;
+                break;
+            }
+        }
+        if (!isReplaced) { tasks.push_back({ filename, isAutosave, std::move(job) }); }
+        isStarting = !isDraining;
+        isDraining = true;
+    }
+    if (isStarting) { drainTasks.Submit("save map", [this] { Drain(); }); }
+}
+
+void MapSaver::Drain() {
+    std::unique_lock<std::mutex> lock(mutex);
+    while (!tasks.empty()) {
+        Task task = std::move(tasks.front());
+        tasks.pop_front();
+        currentFilename = task.filename;
+        isWriting = true;
+        progress = 0.f;
+        lock.unlock();
+        bool isSaved = task.job(progress);
+        task.job = nullptr; // drop the snapshot before the next save, it may still keep a mapped file open
+        lock.lock();
+        isWriting = false;
+        results.push_back({ task.filename, isSaved, task.isAutosave });
+    }
+    isDraining = false;
+}
+
+bool MapSaver::Poll(Result& result) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (results.empty()) return false;
+    result = std::move(results.front());
+    results.pop_front();
+    return true;
+}
+
+void MapSaver::Wait() {
+    drainTasks.Wait();  // a drain no worker has picked up yet runs right here
+}
+
+bool MapSaver::IsBusy() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return isWriting || !tasks.empty();
+}
+
+std::string MapSaver::GetCurrentFilename() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return isWriting ? currentFilename : (tasks.empty() ? std::string() : tasks.front().filename);
+}
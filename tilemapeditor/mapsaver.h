@@ -0,0 +1,50 @@
+#ifndef MAPSAVER_H
+#define MAPSAVER_H
+
+#include <atomic>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include "threadpool.h"
+
+// writes map saves on the thread pool, one at a time in the order they were requested
+// a save job only touches the snapshot it captured, so the editor keeps running (and editing) while it is serialized and written
+class MapSaver {
+public:
+    typedef std::function<bool(std::atomic<float>& progress)> SaveJob;  // serializes and writes one file, reporting progress from 0 to 1
+    struct Result {
+        std::string filename;
+        bool isSaved;
+        bool isAutosave;
+    };
+private:
+    struct Task {
+        std::string filename;
+        bool isAutosave;
+        SaveJob job;
+    };
+    TaskGroup drainTasks;   // the pool task writing the queue, submitted whenever a save is queued while none is running
+    mutable std::mutex mutex;
+    std::deque<Task> tasks; // saves that haven't started yet
+    std::deque<Result> results; // finished saves, collected by the main thread through Poll
+    std::string currentFilename;    // file of the save being written
+    bool isWriting = false;
+    bool isDraining = false;    // a drain task is queued or running, it exits once the queue is empty
+    std::atomic<float> progress{ 0.f };
+
+    void Drain();
+public:
+    MapSaver() = default;
+    ~MapSaver();
+    MapSaver(const MapSaver&) = delete;
+    MapSaver& operator=(const MapSaver&) = delete;
+
+    void Enqueue(const std::string& filename, bool isAutosave, SaveJob job);
+    bool Poll(Result& result);
+    void Wait();    // blocks until every queued save has been written
+    bool IsBusy() const;
+    std::string GetCurrentFilename() const;
+    float GetProgress() const { return progress; }
+};
+#endif
@@ -0,0 +1,270 @@
+#include "renderer.h"
+#include "tileatlas.h"
+#include "layer.h"
+#include "threadpool.h"
+#include <iostream>
+
+namespace {
+    // whether a chunk of layer shares any tile with area
+    bool Overlaps(const RenderFrame::Layer& layer, const RenderFrame::Chunk& chunk, const sf::IntRect& area) {
+        int left = TileMap::GetChunkKeyX(chunk.key) * layer.chunkSize;
+        int top = TileMap::GetChunkKeyY(chunk.key) * layer.chunkSize;
+        return left < area.left + area.width && left + layer.chunkSize > area.left && top < area.top + area.height && top + layer.chunkSize > area.top;
+    }
+}
+
+Renderer::Renderer(sf::RenderWindow& window, TileAtlas& tileAtlas) : window(window), tileAtlas(tileAtlas) {}
+
+void Renderer::Start() {
+    if (thread.joinable()) return;
+    isStopping = false;
+    window.setActive(false);    // a GL context can only be active on one thread at a time
+    thread = std::thread(&Renderer::Run, this);
+}
+
+void Renderer::Stop() {
+    if (!thread.joinable()) return;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        isStopping = true;
+        pendingFrame.reset();
+    }
+    wake.notify_one();
+    taken.notify_all();
+    thread.join();
+}
+
+void Renderer::Submit(std::shared_ptr<const RenderFrame> frame) {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        pendingFrame = std::move(frame);
+    }
+    wake.notify_one();
+}
+
+bool Renderer::IsReady() {
+    std::lock_guard<std::mutex> lock(mutex);
+    return !pendingFrame;
+}
+
+bool Renderer::WaitUntilReady(std::chrono::milliseconds timeout) {
+    std::unique_lock<std::mutex> lock(mutex);
+    return taken.wait_for(lock, timeout, [this] { return !pendingFrame; });
+}
+
+void Renderer::Run() {
+    window.setActive(true);
+    std::unique_lock<std::mutex> lock(mutex);
+    for (;;) {
+        wake.wait(lock, [this] { return isStopping || pendingFrame; });
+        if (isStopping) break;
+        std::shared_ptr<const RenderFrame> frame = std::move(pendingFrame);
+        pendingFrame.reset();
+        lock.unlock();
+        taken.notify_all();     // the editing thread can capture the next frame while this one is drawn
+        Draw(*frame);
+        frame.reset();  // let go of the captured chunks before waiting, they may keep a mapped map file open
+        lock.lock();
+    }
+    lock.unlock();
+    window.setActive(false);
+}
+
+void Renderer::Draw(const RenderFrame& frame) {
+    ++frameCount;
+    // the frame limit is applied by display, which runs here
+    unsigned int limit = frameLimit;
+    if (limit != appliedFrameLimit) {
+        window.setFramerateLimit(limit);
+        appliedFrameLimit = limit;
+    }
+    window.clear();
+    // ui rendering
+    window.setView(frame.uiView);
+    DrawItems(frame.uiItems);
+    // layer rendering, the merged inactive layers below the active one
+    window.setView(frame.layerView);
+    DrawMergedLayers(frame);
+    if (frame.hasActiveLayer) {
+        std::vector<const RenderFrame::Chunk*> chunks;
+        chunks.reserve(frame.activeLayer.chunks.size());
+        for (const RenderFrame::Chunk& chunk : frame.activeLayer.chunks) { chunks.push_back(&chunk); }
+        // all chunks share the atlas texture, their quads are already in world space so no transform is needed
+        sf::RenderStates states;
+        states.texture = &tileAtlas.GetTexture();
+        DrawChunks(window, frame.activeLayer, chunks, frame.tileSize, states);
+    }
+    DrawItems(frame.layerItems);
+    // atlas rendering
+    window.setView(frame.atlasView);
+    DrawItems(frame.atlasItems);
+    // default view for separators
+    window.setView(frame.windowView);
+    DrawItems(frame.windowItems);
+    window.display();
+    ReleaseMeshes();
+}
+
+void Renderer::DrawItems(const std::vector<RenderFrame::Item>& items) {
+    for (const RenderFrame::Item& item : items) { window.draw(*item); }
+}
+
+void Renderer::DrawMergedLayers(const RenderFrame& frame) {
+    if (frame.mergedLayers.empty()) return;
+    const sf::IntRect& visible = frame.mergedArea;
+    if (visible.width <= 0 || visible.height <= 0) return;
+    int size = frame.compositeChunkSize;
+    int firstChunkX = TileMap::FloorDiv(visible.left, size);
+    int firstChunkY = TileMap::FloorDiv(visible.top, size);
+    int lastChunkX = TileMap::FloorDiv(visible.left + visible.width - 1, size);
+    int lastChunkY = TileMap::FloorDiv(visible.top + visible.height - 1, size);
+    // release off-screen composite chunks once the cache grows too big
+    if (compositeChunks.size() > maxCompositeChunks) {
+        for (auto it = compositeChunks.begin(); it != compositeChunks.end();) {
+            int chunkX = TileMap::GetChunkKeyX(it->first);
+            int chunkY = TileMap::GetChunkKeyY(it->first);
+            if (chunkX < firstChunkX || chunkX > lastChunkX || chunkY < firstChunkY || chunkY > lastChunkY) { it = compositeChunks.erase(it); }
+            else { ++it; }
+        }
+    }
+    // the composite texture stores premultiplied colour, so it is drawn with a matching blend mode
+    sf::RenderStates states;
+    states.blendMode = sf::BlendMode(sf::BlendMode::One, sf::BlendMode::OneMinusSrcAlpha);
+    float chunkPixels = static_cast<float>(size * frame.tileSize);
+    std::vector<std::uint64_t> sources;
+    for (int chunkY = firstChunkY; chunkY <= lastChunkY; ++chunkY) {
+        for (int chunkX = firstChunkX; chunkX <= lastChunkX; ++chunkX) {
+            std::int64_t key = TileMap::MakeChunkKey(chunkX, chunkY);
+            CompositeChunk& composite = compositeChunks[key];
+            // only baked again when a chunk it is made of was edited, added or removed, or the merged layers changed
+            sf::IntRect area(chunkX * size, chunkY * size, size, size);
+            sources.clear();
+            for (const RenderFrame::Layer& layer : frame.mergedLayers) {
+                for (const RenderFrame::Chunk& chunk : layer.chunks) {
+                    if (!Overlaps(layer, chunk, area)) continue;
+                    sources.push_back(layer.id);
+                    sources.push_back(static_cast<std::uint64_t>(chunk.key));
+                    sources.push_back(chunk.revision);
+                }
+            }
+            if (!composite.isBaked || sources != composite.sources) {
+                composite.sources = sources;
+                BakeCompositeChunk(frame, key, composite);
+            }
+            if (composite.isEmpty) continue;
+            sf::Sprite sprite(composite.texture->getTexture());
+            sprite.setPosition(chunkX * chunkPixels, chunkY * chunkPixels);
+            window.draw(sprite, states);
+        }
+    }
+}
+
+void Renderer::BakeCompositeChunk(const RenderFrame& frame, std::int64_t key, CompositeChunk& composite) {
+    composite.isBaked = true;
+    // no source chunks means no content, so empty parts of the map never allocate a render texture
+    composite.isEmpty = composite.sources.empty();
+    if (composite.isEmpty) return;
+    int size = frame.compositeChunkSize;
+    sf::IntRect area(TileMap::GetChunkKeyX(key) * size, TileMap::GetChunkKeyY(key) * size, size, size);
+    unsigned int pixels = static_cast<unsigned int>(size * frame.tileSize);
+    if (!composite.texture) {
+        composite.texture.reset(new sf::RenderTexture());
+        if (!composite.texture->create(pixels, pixels)) {
+            std::cerr << "Failed to create composite texture for merged layers\n";
+            composite.texture.reset();
+            composite.isEmpty = true;
+            return;
+        }
+    }
+    // the texture holds premultiplied colour: blending half opacity tiles onto transparent black gives colour * alpha
+    composite.texture->clear(sf::Color::Transparent);
+    sf::RenderStates states;
+    states.texture = &tileAtlas.GetTexture();
+    states.transform.translate(-area.left * static_cast<float>(frame.tileSize), -area.top * static_cast<float>(frame.tileSize));
+    std::vector<const RenderFrame::Chunk*> chunks;
+    for (const RenderFrame::Layer& layer : frame.mergedLayers) {   // bake in layer order so higher layers cover lower ones exactly like drawing them one by one
+        chunks.clear();
+        for (const RenderFrame::Chunk& chunk : layer.chunks) {
+            if (Overlaps(layer, chunk, area)) chunks.push_back(&chunk);
+        }
+        DrawChunks(*composite.texture, layer, chunks, frame.tileSize, states);
+    }
+    composite.texture->display();
+}
+
+void Renderer::DrawChunks(sf::RenderTarget& target, const RenderFrame::Layer& layer, const std::vector<const RenderFrame::Chunk*>& chunks, int tileSize, const sf::RenderStates& states) {
+    if (chunks.empty()) return;
+    // only rebuild chunks that were edited since their mesh was built (or are drawn at a different opacity)
+    // the mesh entries are created first, so the rebuilds spread over the thread pool never touch the cache itself
+    std::unordered_map<std::int64_t, ChunkMesh>& layerMeshes = meshes[layer.id];
+    std::vector<ChunkMesh*> chunkMeshes;
+    std::vector<size_t> stale;
+    chunkMeshes.reserve(chunks.size());
+    for (const RenderFrame::Chunk* chunk : chunks) {
+        auto result = layerMeshes.emplace(chunk->key, ChunkMesh());
+        if (result.second) ++meshCount;
+        ChunkMesh& mesh = result.first->second;
+        mesh.lastFrame = frameCount;
+        if (!mesh.isBuilt || mesh.revision != chunk->revision || mesh.alpha != layer.alpha) { stale.push_back(chunkMeshes.size()); }
+        chunkMeshes.push_back(&mesh);
+    }
+    ThreadPool::GetShared().ParallelFor("rebuild chunk meshes", stale.size(), [&](size_t i) {
+        RebuildChunk(layer, *chunks[stale[i]], tileSize, *chunkMeshes[stale[i]]);
+    });
+    for (ChunkMesh* mesh : chunkMeshes) { target.draw(mesh->vertices, states); }
+}
+
+void Renderer::RebuildChunk(const RenderFrame::Layer& layer, const RenderFrame::Chunk& chunk, int tileSize, ChunkMesh& mesh) const {
+    // only reads the frame and the atlas and only writes this mesh, so meshes of different chunks can be rebuilt at the same time
+    mesh.vertices.clear();
+    sf::Color color(255, 255, 255, layer.alpha);
+    // top left tile of this chunk in layer coordinates
+    int startX = TileMap::GetChunkKeyX(chunk.key) * layer.chunkSize;
+    int startY = TileMap::GetChunkKeyY(chunk.key) * layer.chunkSize;
+    float size = static_cast<float>(tileSize);
+    const TileCell* cells = chunk.cells.get();
+    for (int localY = 0; localY < layer.chunkSize; ++localY) {
+        for (int localX = 0; localX < layer.chunkSize; ++localX) {
+            TileCell cell = cells[localY * layer.chunkSize + localX];
+            if (cell == EmptyCell) continue;   // empty cells get no quad
+            // the texture rect is looked up from the atlas, corners are ordered top-left, top-right, bottom-right, bottom-left
+            sf::FloatRect rect(tileAtlas.GetTileRect(GetCellAtlasIndex(cell)));
+            sf::Vector2f texCoords[4] = {
+                { rect.left, rect.top },
+                { rect.left + rect.width, rect.top },
+                { rect.left + rect.width, rect.top + rect.height },
+                { rect.left, rect.top + rect.height }
+            };
+            std::uint32_t flags = GetCellFlags(cell);
+            if (flags & FlipDiagonal) { std::swap(texCoords[1], texCoords[3]); }    // transpose first, then mirror
+            if (flags & FlipHorizontal) { std::swap(texCoords[0], texCoords[1]); std::swap(texCoords[2], texCoords[3]); }
+            if (flags & FlipVertical) { std::swap(texCoords[0], texCoords[3]); std::swap(texCoords[1], texCoords[2]); }
+            // quads are built in world space, zoom and panning are applied by the layer view
+            float left = (startX + localX) * size;
+            float top = (startY + localY) * size;
+            mesh.vertices.append(sf::Vertex(sf::Vector2f(left, top), color, texCoords[0]));
+            mesh.vertices.append(sf::Vertex(sf::Vector2f(left + size, top), color, texCoords[1]));
+            mesh.vertices.append(sf::Vertex(sf::Vector2f(left + size, top + size), color, texCoords[2]));
+            mesh.vertices.append(sf::Vertex(sf::Vector2f(left, top + size), color, texCoords[3]));
+        }
+    }
+    mesh.revision = chunk.revision;
+    mesh.alpha = layer.alpha;
+    mesh.isBuilt = true;
+}
+
+void Renderer::ReleaseMeshes() {
+    // meshes of chunks that were not drawn this frame (scrolled away, erased, or from layers that are gone) are dropped once the cache grows too big
+    if (meshCount <= maxMeshes) return;
+    for (auto layerIt = meshes.begin(); layerIt != meshes.end();) {
+        for (auto it = layerIt->second.begin(); it != layerIt->second.end();) {
+            if (it->second.lastFrame != frameCount) {
+                it = layerIt->second.erase(it);
+                --meshCount;
+            }
+            else { ++it; }
+        }
+        if (layerIt->second.empty()) { layerIt = meshes.erase(layerIt); }
+        else { ++layerIt; }
+    }
+}
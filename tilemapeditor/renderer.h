@@ -0,0 +1,105 @@
+#ifndef RENDERER_H
+#define RENDERER_H
+
+#include <SFML/Graphics.hpp>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include "tilecell.h"
+
+struct TileAtlas;
+
+// everything one frame shows, captured by the editing thread and never changed once it is handed to the renderer
+// drawables are copies made for the frame, tile chunks share their cells with the map, which copies a captured chunk before editing it again
+struct RenderFrame {
+    typedef std::shared_ptr<const sf::Drawable> Item;
+    struct Chunk {
+        std::int64_t key;
+        std::uint64_t revision;     // map revision of the chunk's last edit, a cached mesh is rebuilt once it differs
+        std::shared_ptr<const TileCell> cells;
+    };
+    struct Layer {
+        std::uint64_t id = 0;   // unique for every layer the map ever held, meshes are cached per layer id and chunk key
+        int chunkSize = 32;
+        sf::Uint8 alpha = 255;
+        std::vector<Chunk> chunks;  // only the chunks overlapping the part of the layer that is drawn
+    };
+    sf::View windowView;    // the default view, for the separators
+    sf::View uiView;
+    sf::View layerView;
+    sf::View atlasView;
+    int tileSize = 16;
+    std::vector<Item> uiItems;
+    std::vector<Layer> mergedLayers;    // visible inactive layers in layer order, only captured while the merged view is shown
+    sf::IntRect mergedArea;     // tiles of the layer view on screen, the merged view covers the composite chunks overlapping it
+    int compositeChunkSize = 32;
+    Layer activeLayer;
+    bool hasActiveLayer = false;
+    std::vector<Item> layerItems;   // drawn over the tiles, e.g. the grid
+    std::vector<Item> atlasItems;
+    std::vector<Item> windowItems;  // drawn last with the default view
+};
+
+// draws frames on its own thread with the window's GL context, so a slow frame never holds up input and a slow edit never holds up a frame
+// the editing thread hands over at most one frame ahead: while one is pending it keeps handling input and captures the next one once the renderer took it
+// chunk meshes and the baked merged view are cached here, the map itself is never touched by the render thread
+class Renderer {
+private:
+    struct ChunkMesh {
+        sf::VertexArray vertices{ sf::Quads };  // one textured quad per non-empty tile in the chunk, drawn with a single draw call
+        std::uint64_t revision = 0;     // chunk revision the quads were built from
+        sf::Uint8 alpha = 255;          // opacity the quads were built with, a different opacity also forces a rebuild
+        bool isBuilt = false;
+        std::uint64_t lastFrame = 0;    // frame the mesh was last drawn in, meshes that fell off screen are dropped when the cache grows
+    };
+    struct CompositeChunk {
+        std::unique_ptr<sf::RenderTexture> texture;    // every merged layer of this chunk baked together, created on the first bake that has content
+        std::vector<std::uint64_t> sources;    // layer id, chunk key and revision of every chunk it was baked from, a different list re-bakes it
+        bool isBaked = false;
+        bool isEmpty = true;    // no merged layer has tiles here, so nothing is drawn
+    };
+    sf::RenderWindow& window;
+    TileAtlas& tileAtlas;
+    std::thread thread;
+    std::mutex mutex;
+    std::condition_variable wake;   // signalled when a frame is handed over or the renderer stops
+    std::condition_variable taken;  // signalled when the render thread takes the pending frame
+    std::shared_ptr<const RenderFrame> pendingFrame;
+    bool isStopping = false;
+    std::atomic<unsigned int> frameLimit{ 0 };
+    unsigned int appliedFrameLimit = 0;     // only used by the render thread
+    std::uint64_t frameCount = 0;
+    std::unordered_map<std::uint64_t, std::unordered_map<std::int64_t, ChunkMesh>> meshes;  // per layer id, then chunk key
+    size_t meshCount = 0;
+    size_t maxMeshes = 4096;    // off-screen meshes are released once the cache grows past this
+    std::unordered_map<std::int64_t, CompositeChunk> compositeChunks;
+    size_t maxCompositeChunks = 64;     // off-screen composite chunks are released once the cache grows past this
+
+    void Run();
+    void Draw(const RenderFrame& frame);
+    void DrawItems(const std::vector<RenderFrame::Item>& items);
+    void DrawMergedLayers(const RenderFrame& frame);
+    void BakeCompositeChunk(const RenderFrame& frame, std::int64_t key, CompositeChunk& composite);
+    void DrawChunks(sf::RenderTarget& target, const RenderFrame::Layer& layer, const std::vector<const RenderFrame::Chunk*>& chunks, int tileSize, const sf::RenderStates& states);
+    void RebuildChunk(const RenderFrame::Layer& layer, const RenderFrame::Chunk& chunk, int tileSize, ChunkMesh& mesh) const;
+    void ReleaseMeshes();
+public:
+    Renderer(sf::RenderWindow& window, TileAtlas& tileAtlas);
+    ~Renderer() { Stop(); }
+    Renderer(const Renderer&) = delete;
+    Renderer& operator=(const Renderer&) = delete;
+
+    void Start();   // the calling thread gives up the window's GL context to the render thread
+    void Stop();    // a frame that is still pending is dropped, the context is free again afterwards
+    void Submit(std::shared_ptr<const RenderFrame> frame);
+    bool IsReady();     // the previous frame has been taken, so a new one can be captured
+    bool WaitUntilReady(std::chrono::milliseconds timeout);
+    void SetFrameLimit(unsigned int limit) { frameLimit = limit; }
+};
+#endif
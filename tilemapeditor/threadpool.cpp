@@ -0,0 +1,309 @@
+#include "threadpool.h"
+#include <algorithm>
+#include <cstring>
+#include <iomanip>
+
+namespace {
+    // the pool and worker index of the current thread, so tasks submitted from a worker land on its own deque
+    thread_local const ThreadPool* currentPool = nullptr;
+    thread_local size_t currentWorker = 0;
+}
+
+TaskGroup::TaskGroup() : pool(ThreadPool::GetShared()) {}
+
+void TaskGroup::Submit(const char* name, std::function<void()> task) {
+    pool.Push({ std::move(task), this, name });
+}
+
+void TaskGroup::Then(const char* name, std::function<void()> task) {
+    {
+        std::lock_guard<std::mutex> lock(pool.mutex);
+        if (pending > 0) {
+            continuation = std::move(task);
+            continuationName = name;
+            isContinuationOnMainThread = false;
+            return;
+        }
+    }
+    pool.Submit(name, std::move(task));  // everything has already finished
+}
+
+void TaskGroup::ThenOnMainThread(std::function<void()> callback) {
+    {
+        std::lock_guard<std::mutex> lock(pool.mutex);
+        if (pending > 0) {
+            continuation = std::move(callback);
+            continuationName = nullptr;
+            isContinuationOnMainThread = true;
+            return;
+        }
+    }
+    pool.PostToMainThread(std::move(callback));
+}
+
+void TaskGroup::Wait() {
+    // queued tasks of the group are run here rather than waited for, so waiting from a task or with every worker busy still finishes
+    ThreadPool::Task task;
+    while (pool.TakeGroupTask(*this, task)) { pool.Execute(task); }
+    std::unique_lock<std::mutex> lock(pool.mutex);
+    pool.finished.wait(lock, [this] { return pending == 0; });
+}
+
+bool TaskGroup::IsDone() const {
+    std::lock_guard<std::mutex> lock(pool.mutex);
+    return pending == 0;
+}
+
+ThreadPool::ThreadPool(size_t workerCount, size_t loopThreadCount) : loopThreadCount(std::max<size_t>(1, loopThreadCount)), startTime(std::chrono::steady_clock::now()) {
+    for (size_t i = 0; i < workerCount; ++i) { queues.emplace_back(new WorkQueue); }
+    for (size_t i = 0; i < workerCount; ++i) { workers.emplace_back(&ThreadPool::Run, this, i); }
+}
+
+ThreadPool::~ThreadPool() {
+    // tasks that are still queued run before the workers stop
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        isStopping = true;
+    }
+    wake.notify_all();
+    for (std::thread& worker : workers) { worker.join(); }
+}
+
+ThreadPool& ThreadPool::GetShared() {
+    // a single core still gets one worker so background tasks make progress, loops then just run on the caller
+    static const unsigned cores = std::max(1u, std::thread::hardware_concurrency());
+    static ThreadPool pool(std::max(1u, cores - 1), cores);
+    return pool;
+}
+
+bool ThreadPool::IsWorkerThread() const {
+    return currentPool == this;
+}
+
+void ThreadPool::Run(size_t workerIndex) {
+    currentPool = this;
+    currentWorker = workerIndex;
+    std::unique_lock<std::mutex> lock(mutex);
+    for (;;) {
+        // batches that have handed out every index are dropped, whoever is still running their last indices finishes them
+        batches.erase(std::remove_if(batches.begin(), batches.end(), [](const std::shared_ptr<Batch>& batch) {
+            return batch->next >= batch->count;
+        }), batches.end());
+        if (!batches.empty()) {
+            // loops go first, somebody is waiting on them
+            std::shared_ptr<Batch> batch = batches.front();
+            lock.unlock();
+            Work(*batch);
+            lock.lock();
+            continue;
+        }
+        if (queuedTasks > 0) {
+            lock.unlock();
+            Task task;
+            if (TakeTask(workerIndex, task)) { Execute(task); }
+            else { std::this_thread::yield(); }   // counted but not pushed yet
+            lock.lock();
+            continue;
+        }
+        if (isStopping) return;
+        wake.wait(lock);
+    }
+}
+
+void ThreadPool::Work(Batch& batch) {
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    size_t processed = 0;
+    for (size_t i = batch.next++; i < batch.count; i = batch.next++) {
+        (*batch.body)(i);
+        ++processed;
+        if (++batch.done == batch.count) {
+            std::lock_guard<std::mutex> lock(mutex);
+            finished.notify_all();
+        }
+    }
+    if (processed > 0) { Record(batch.name, processed, start); }
+}
+
+void ThreadPool::Push(Task task) {
+    WorkQueue& queue = IsWorkerThread() ? *queues[currentWorker] : injected;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (task.group) { ++task.group->pending; }
+        ++queuedTasks;
+    }
+    {
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        queue.tasks.push_back(std::move(task));
+    }
+    wake.notify_one();
+}
+
+bool ThreadPool::TakeTask(size_t workerIndex, Task& task) {
+    {
+        // newest first from the own deque, its data is most likely still in cache
+        WorkQueue& own = *queues[workerIndex];
+        std::lock_guard<std::mutex> lock(own.mutex);
+        if (!own.tasks.empty()) {
+            task = std::move(own.tasks.back());
+            own.tasks.pop_back();
+            --queuedTasks;
+            return true;
+        }
+    }
+    for (size_t i = 0; i <= queues.size(); ++i) {
+        // then the oldest injected task, then the oldest task of each other worker
+        WorkQueue& queue = i == 0 ? injected : *queues[(workerIndex + i) % queues.size()];
+        if (&queue == queues[workerIndex].get()) continue;
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        if (!queue.tasks.empty()) {
+            task = std::move(queue.tasks.front());
+            queue.tasks.pop_front();
+            --queuedTasks;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool ThreadPool::TakeGroupTask(const TaskGroup& group, Task& task) {
+    for (size_t i = 0; i <= queues.size(); ++i) {
+        WorkQueue& queue = i == 0 ? injected : *queues[i - 1];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        auto it = std::find_if(queue.tasks.begin(), queue.tasks.end(), [&group](const Task& queued) { return queued.group == &group; });
+        if (it != queue.tasks.end()) {
+            task = std::move(*it);
+            queue.tasks.erase(it);
+            --queuedTasks;
+            return true;
+        }
+    }
+    return false;
+}
+
+void ThreadPool::Execute(Task& task) {
+    ++runningTasks;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    task.function();
+    task.function = nullptr;    // captured state is released before the group counts the task as done
+    Record(task.name, 1, start);
+    FinishTask(task.group);
+    --runningTasks;
+}
+
+void ThreadPool::FinishTask(TaskGroup* group) {
+    if (!group) return;
+    std::function<void()> continuation;
+    const char* continuationName;
+    bool isOnMainThread;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (--group->pending > 0) return;
+        continuation.swap(group->continuation);
+        continuationName = group->continuationName;
+        isOnMainThread = group->isContinuationOnMainThread;
+        finished.notify_all();
+    }
+    // a waiter may have seen the group finish and destroyed it, only the moved out continuation is used from here on
+    if (!continuation) return;
+    if (isOnMainThread) { PostToMainThread(std::move(continuation)); }
+    else { Submit(continuationName, std::move(continuation)); }
+}
+
+void ThreadPool::Submit(const char* name, std::function<void()> task) {
+    Push({ std::move(task), nullptr, name });
+}
+
+void ThreadPool::ParallelFor(const char* name, size_t count, const std::function<void(size_t)>& body) {
+    if (count == 0) return;
+    if (count == 1 || loopThreadCount <= 1) {
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < count; ++i) { body(i); }
+        Record(name, count, start);
+        return;
+    }
+    std::shared_ptr<Batch> batch = std::make_shared<Batch>();
+    batch->body = &body;
+    batch->count = count;
+    batch->name = name;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        batches.push_back(batch);
+    }
+    wake.notify_all();
+    Work(*batch);
+    // indices other threads picked up may still be running
+    std::unique_lock<std::mutex> lock(mutex);
+    finished.wait(lock, [&batch] { return batch->done == batch->count; });
+}
+
+void ThreadPool::PostToMainThread(std::function<void()> callback) {
+    {
+        std::lock_guard<std::mutex> lock(callbacksMutex);
+        mainThreadCallbacks.push_back(std::move(callback));
+    }
+    callbackPosted.notify_all();
+}
+
+size_t ThreadPool::RunMainThreadCallbacks() {
+    std::vector<std::function<void()>> callbacks;
+    {
+        std::lock_guard<std::mutex> lock(callbacksMutex);
+        callbacks.swap(mainThreadCallbacks);
+    }
+    // callbacks posted while these run are picked up next frame
+    for (std::function<void()>& callback : callbacks) { callback(); }
+    return callbacks.size();
+}
+
+bool ThreadPool::WaitForMainThreadCallbacks(std::chrono::steady_clock::time_point deadline) {
+    std::unique_lock<std::mutex> lock(callbacksMutex);
+    return callbackPosted.wait_until(lock, deadline, [this] { return !mainThreadCallbacks.empty(); });
+}
+
+bool ThreadPool::HasMainThreadCallbacks() const {
+    std::lock_guard<std::mutex> lock(callbacksMutex);
+    return !mainThreadCallbacks.empty();
+}
+
+void ThreadPool::Record(const char* name, std::uint64_t count, std::chrono::steady_clock::time_point start) {
+    std::uint64_t nanoseconds = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+    if (IsWorkerThread()) { workerBusyNanoseconds += nanoseconds; }
+    if (!name) name = "unnamed";
+    Counter* counter = nullptr;
+    {
+        std::lock_guard<std::mutex> lock(countersMutex);
+        for (Counter& existing : counters) {
+            if (existing.name == name || std::strcmp(existing.name, name) == 0) {
+                counter = &existing;
+                break;
+            }
+        }
+        if (!counter) {
+            counters.emplace_back(name);
+            counter = &counters.back();
+        }
+    }
+    counter->count += count;
+    counter->nanoseconds += nanoseconds;
+}
+
+std::vector<ThreadPool::TaskStats> ThreadPool::GetTaskStats() const {
+    std::vector<TaskStats> stats;
+    std::lock_guard<std::mutex> lock(countersMutex);
+    for (const Counter& counter : counters) { stats.push_back({ counter.name, counter.count, counter.nanoseconds * 1e-9 }); }
+    return stats;
+}
+
+double ThreadPool::GetUtilization() const {
+    double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+    if (workers.empty() || elapsed <= 0.0) return 0.0;
+    return workerBusyNanoseconds * 1e-9 / (elapsed * workers.size());
+}
+
+void ThreadPool::PrintStats(std::ostream& out) const {
+    out << "Thread pool: " << workers.size() << " workers, " << std::fixed << std::setprecision(1) << GetUtilization() * 100.0 << "% busy\n";
+    for (const TaskStats& stats : GetTaskStats()) {
+        out << "  " << stats.name << ": " << stats.count << " runs, " << std::setprecision(3) << stats.seconds * 1000.0 << " ms\n";
+    }
+    out.unsetf(std::ios::floatfield);
+}
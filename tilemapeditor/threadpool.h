@@ -0,0 +1,128 @@
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+class ThreadPool;
+
+// tasks that are waited on together, e.g. a background load or the chunks of a bulk edit, optionally followed by a continuation
+// a group can be reused once it has finished, its destructor waits for whatever is still running
+class TaskGroup {
+private:
+    friend class ThreadPool;
+    ThreadPool& pool;
+    size_t pending = 0;     // submitted tasks that haven't finished, guarded by the pool's mutex like the continuation
+    std::function<void()> continuation; // submitted or posted to the main thread once pending drops to zero
+    const char* continuationName = nullptr;
+    bool isContinuationOnMainThread = false;
+public:
+    TaskGroup();    // uses the shared pool
+    explicit TaskGroup(ThreadPool& pool) : pool(pool) {}
+    ~TaskGroup() { Wait(); }
+    TaskGroup(const TaskGroup&) = delete;
+    TaskGroup& operator=(const TaskGroup&) = delete;
+
+    void Submit(const char* name, std::function<void()> task);
+    void Then(const char* name, std::function<void()> task);   // runs on the pool after every task of the group, a group has one continuation
+    void ThenOnMainThread(std::function<void()> callback);      // runs in RunMainThreadCallbacks after every task of the group
+    void Wait();    // the group's queued tasks run on the calling thread while the rest finish elsewhere
+    bool IsDone() const;
+};
+
+// job system of the editor: fixed worker threads with a work-stealing deque each
+// tasks submitted from a worker go to its own deque and are taken back newest first, idle workers steal the oldest ones,
+// tasks submitted from other threads are shared by every worker. ParallelFor splits a loop over the pool with the caller helping,
+// may be called from any thread (and from inside a task or another loop), and never waits on a worker that is busy with something else
+// every task and loop is timed under its name, names are expected to be string literals
+class ThreadPool {
+public:
+    struct TaskStats {
+        std::string name;
+        std::uint64_t count;    // tasks run, or loop indices for ParallelFor
+        double seconds;         // time spent running them, summed over threads
+    };
+private:
+    friend class TaskGroup;
+    struct Batch {
+        const std::function<void(size_t)>* body;
+        size_t count;
+        const char* name;
+        std::atomic<size_t> next{ 0 };  // next index to hand out
+        std::atomic<size_t> done{ 0 };  // indices that have finished
+    };
+    struct Task {
+        std::function<void()> function;
+        TaskGroup* group;   // null for fire and forget tasks
+        const char* name;
+    };
+    struct WorkQueue {
+        std::mutex mutex;
+        std::deque<Task> tasks;
+    };
+    struct Counter {
+        explicit Counter(const char* name) : name(name) {}
+        const char* name;
+        std::atomic<std::uint64_t> count{ 0 };
+        std::atomic<std::uint64_t> nanoseconds{ 0 };
+    };
+    std::vector<std::thread> workers;
+    std::vector<std::unique_ptr<WorkQueue>> queues;  // one per worker
+    WorkQueue injected;     // tasks submitted from threads outside the pool
+    size_t loopThreadCount; // threads a ParallelFor is spread over, the caller included
+    std::mutex mutex;       // guards batches, isStopping and the groups' pending counts
+    std::condition_variable wake;       // signalled when work is added or the pool stops
+    std::condition_variable finished;   // signalled when a batch or a task group finishes
+    std::vector<std::shared_ptr<Batch>> batches;    // batches that still have indices to hand out
+    std::atomic<size_t> queuedTasks{ 0 };   // tasks sitting in any queue, only raised while holding mutex so a sleeping worker never misses one
+    std::atomic<size_t> runningTasks{ 0 };
+    bool isStopping = false;
+    mutable std::mutex callbacksMutex;
+    std::vector<std::function<void()>> mainThreadCallbacks;
+    std::condition_variable callbackPosted;     // wakes a main thread waiting for callbacks
+    mutable std::mutex countersMutex;
+    std::deque<Counter> counters;   // a deque so counters never move while tasks update them
+    std::chrono::steady_clock::time_point startTime;
+    std::atomic<std::uint64_t> workerBusyNanoseconds{ 0 };
+
+    void Run(size_t workerIndex);
+    void Work(Batch& batch);
+    void Push(Task task);
+    bool TakeTask(size_t workerIndex, Task& task);  // own deque first, then the injected tasks, then stealing from the other workers
+    bool TakeGroupTask(const TaskGroup& group, Task& task);
+    void Execute(Task& task);
+    void FinishTask(TaskGroup* group);
+    void Record(const char* name, std::uint64_t count, std::chrono::steady_clock::time_point start);
+    bool IsWorkerThread() const;
+public:
+    ThreadPool(size_t workerCount, size_t loopThreadCount);
+    ~ThreadPool();
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    static ThreadPool& GetShared();  // one worker per core besides the main thread (at least one), created on first use
+    size_t GetThreadCount() const { return loopThreadCount; }
+    void Submit(const char* name, std::function<void()> task);  // fire and forget, use a TaskGroup to wait for tasks
+    // calls body(i) for every i in [0, count) spread over the pool, returns once every call has finished
+    void ParallelFor(const char* name, size_t count, const std::function<void(size_t)>& body);
+    void PostToMainThread(std::function<void()> callback);
+    size_t RunMainThreadCallbacks();    // called once per frame by the editor, returns how many callbacks ran
+    bool IsBusy() const { return queuedTasks > 0 || runningTasks > 0 || HasMainThreadCallbacks(); }
+    bool HasMainThreadCallbacks() const;
+    bool WaitForMainThreadCallbacks(std::chrono::steady_clock::time_point deadline);  // returns once a callback is posted (true) or at the deadline
+    std::vector<TaskStats> GetTaskStats() const;
+    double GetUtilization() const;  // share of the workers' time spent running tasks since the pool started
+    void PrintStats(std::ostream& out) const;
+};
+#endif
@@ -1,23 +1,35 @@
 #include "tileatlas.h"
 #include "editor.h"
+#include <cmath>
 
 TileAtlas::TileAtlas(Editor& editor) : editor(editor) {}
 
 // function to load the image into a texture which will be used as the tile atlas, tileWidth/Height will be defined as 16, 16 when called in the editor
 bool TileAtlas::Initialize() {
-    if (!textureAtlas.loadFromFile("assets/map/tilemap16.png")) { return false; }
+    if (!textureAtlas.loadFromFile(atlasPath)) { return false; }
     atlasSprite.setTexture(textureAtlas);
     atlasSprite.setPosition(0.f, 0.f); // set to top left of the atlas viewport
+    atlasColumns = std::max(1, static_cast<int>(textureAtlas.getSize().x) / editor.baseTileSize);
     return true;
 }
 
+// texture rect of the tile at an atlas index (tiles are numbered row by row)
+sf::IntRect TileAtlas::GetTileRect(int index) const {
+    int tileSize = editor.baseTileSize;
+    return sf::IntRect((index % atlasColumns) * tileSize, (index / atlasColumns) * tileSize, tileSize, tileSize);
+}
+
+// atlas index of the tile whose texture rect starts at rect's top left corner
+int TileAtlas::GetTileIndex(const sf::IntRect& rect) const {
+    return (rect.top / editor.baseTileSize) * atlasColumns + (rect.left / editor.baseTileSize);
+}
+
 void TileAtlas::HandleSelection(sf::Vector2f mousePos, bool isSelecting, float deltaTime) {
-    // adjust mouse position by adding the atlas view offset and dividing by the scale factor
-    sf::Vector2f adjustedMousePos = (mousePos + editor.atlasViewOffset) / editor.atlasScaleFactor;
+    // the mouse position is already in atlas texture space since zoom and panning only change the atlas view
     // snap the mouse selection to the nearest grid position (so selection start and end are always in a gridcell)
     sf::Vector2i texturePos(
-        static_cast<int>(adjustedMousePos.x / editor.baseTileSize) * editor.baseTileSize,
-        static_cast<int>(adjustedMousePos.y / editor.baseTileSize) * editor.baseTileSize
+        static_cast<int>(std::floor(mousePos.x / editor.baseTileSize)) * editor.baseTileSize,
+        static_cast<int>(std::floor(mousePos.y / editor.baseTileSize)) * editor.baseTileSize
     );
     // if true was passed in from handle events, and we aren't already selecting, start a new selection and store the starting indices
     if (isSelecting) {
@@ -25,11 +37,13 @@ void TileAtlas::HandleSelection(sf::Vector2f mousePos, bool isSelecting, float d
             this->isSelecting = true;   // start a new selection
             selectionStartIndices = texturePos; // store the starting grid position
         }
+        if (selectionEndIndices != texturePos) { editor.RequestRedraw(); }  // the drag rectangle only changes when the end cell does
         selectionEndIndices = texturePos;   // update the end of the selection constantly until false is passed in
     }
     else {  // else if false was passed in (right click released), finalize the selection and get the whole selections bounds
         if (this->isSelecting) {
             this->isSelecting = false;  // finalize the selection
+            editor.RequestRedraw(); // remove the drag rectangle
             // calculate selection bounds
             sf::IntRect bounds = GetSelectionBounds();
             selectedTile.selectionBounds = bounds;
@@ -44,53 +58,39 @@ void TileAtlas::HandleSelection(sf::Vector2f mousePos, bool isSelecting, float d
     }
 }
 
-void TileAtlas::DrawAtlas(sf::RenderTarget& target) {
-    sf::Vector2f offset = editor.atlasViewOffset;   // offset is based on the view offset which updates when panning
-    float scaledTileSize = atlasTileSize; // scaledTileSize is based on tileSize which updates when zooming
-    // scale the atlas sprite tiles based on the zoom
-    atlasSprite.setScale(scaledTileSize / editor.baseTileSize, scaledTileSize / editor.baseTileSize);
-    atlasSprite.setPosition(-offset);   // set the atlas sprite position based on the panning offset
-    target.draw(atlasSprite);
-    // draw grid with fixed dimensions of 50x100
-    int gridWidth = 50;
-    int gridHeight = 100;
-    sf::RectangleShape line;    // create line shape to draw grid with
-    line.setFillColor(sf::Color(100, 100, 100, 150));
-    // starting positions of horizontal and vertical gridlines based on the offset 
-    float startX = -offset.x;
-    float startY = -offset.y;
-    // iterate from the starting offset up to the grids width and height (gridWidth/Height * atlasTileSize) and draw the grid lines
-    for (float x = startX; x <= gridWidth * atlasTileSize - offset.x; x += atlasTileSize) {
-        line.setSize(sf::Vector2f(1.f, gridHeight * atlasTileSize)); // height of the grid
-        line.setPosition(x, -offset.y); // position of each drawn line relative to the offset caused by panning
-        target.draw(line);
-    }
-    // same here but for horizontal grid lines
-    for (float y = startY; y <= gridHeight * atlasTileSize - offset.y; y += atlasTileSize) {
-        line.setSize(sf::Vector2f(gridWidth * atlasTileSize, 1.f)); // width of the grid
-        line.setPosition(-offset.x, y);
-        target.draw(line);
+void TileAtlas::AddToFrame(RenderFrame& frame) {
+    float tileSize = static_cast<float>(editor.baseTileSize);
+    // the part of the atlas view that is on screen, zoom and panning are handled by the view itself
+    sf::FloatRect area = editor.GetVisibleArea(frame.atlasView);
+    // clip the atlas sprite to the on-screen part of the texture so off-screen texels are never submitted
+    sf::Vector2u textureSize = textureAtlas.getSize();
+    int texLeft = std::max(0, static_cast<int>(std::floor(area.left)));
+    int texTop = std::max(0, static_cast<int>(std::floor(area.top)));
+    int texRight = std::min(static_cast<int>(textureSize.x), static_cast<int>(std::ceil(area.left + area.width)));
+    int texBottom = std::min(static_cast<int>(textureSize.y), static_cast<int>(std::ceil(area.top + area.height)));
+    if (texRight > texLeft && texBottom > texTop) {
+        std::shared_ptr<sf::Sprite> sprite = std::make_shared<sf::Sprite>(atlasSprite);
+        sprite->setTextureRect(sf::IntRect(texLeft, texTop, texRight - texLeft, texBottom - texTop));
+        sprite->setPosition(static_cast<float>(texLeft), static_cast<float>(texTop));
+        frame.atlasItems.push_back(sprite);
     }
-}
-
-void TileAtlas::DrawDragSelection(sf::RenderTarget& target) {
+    // the grid covers exactly the tiles of the atlas texture
+    int gridWidth = static_cast<int>(textureSize.x) / editor.baseTileSize;
+    int gridHeight = static_cast<int>(textureSize.y) / editor.baseTileSize;
+    // only the grid lines whose cells are on screen are drawn, batched into a single draw call
+    int firstColumn = std::max(0, static_cast<int>(std::floor(area.left / tileSize)));
+    int firstRow = std::max(0, static_cast<int>(std::floor(area.top / tileSize)));
+    int lastColumn = std::min(gridWidth, static_cast<int>(std::ceil((area.left + area.width) / tileSize)));
+    int lastRow = std::min(gridHeight, static_cast<int>(std::ceil((area.top + area.height) / tileSize)));
+    frame.atlasItems.push_back(editor.CreateGrid(frame.atlasView, sf::IntRect(firstColumn, firstRow, lastColumn - firstColumn, lastRow - firstRow), tileSize));
     // when isSelecting is passed in as true to handle selection, draw a selection box based on the calculated bounds
     if (isSelecting) {
         sf::IntRect bounds = GetSelectionBounds();  // get the bounds of the selection rectangle based on the start and end selection indices
-        // bounds left and top are scaled with atlasScaleFactor to reflect the zoom level, the atlasViewOffset is then subtracted to ensure alignment with a zoomed and panned grid
-        sf::Vector2f adjustedPosition(
-            (bounds.left * editor.atlasScaleFactor) - editor.atlasViewOffset.x,
-            (bounds.top * editor.atlasScaleFactor) - editor.atlasViewOffset.y
-        );
-        // bounds width and height are also scaled with atlasScaleFactor to reflect the zoom level
-        sf::Vector2f adjustedSize(
-            bounds.width * editor.atlasScaleFactor,
-            bounds.height * editor.atlasScaleFactor
-        );
-        sf::RectangleShape selectionRect(adjustedSize);
-        selectionRect.setPosition(adjustedPosition);
-        selectionRect.setFillColor(sf::Color(0, 255, 0, 100));
-        target.draw(selectionRect);
+        // the bounds are in atlas texture space, which is also the atlas view's world space
+        std::shared_ptr<sf::RectangleShape> selectionRect = std::make_shared<sf::RectangleShape>(sf::Vector2f(static_cast<float>(bounds.width), static_cast<float>(bounds.height)));
+        selectionRect->setPosition(static_cast<float>(bounds.left), static_cast<float>(bounds.top));
+        selectionRect->setFillColor(sf::Color(0, 255, 0, 100));
+        frame.atlasItems.push_back(selectionRect);
     }
 }
 
@@ -102,22 +102,18 @@ sf::IntRect TileAtlas::GetSelectionBounds() const {
     return sf::IntRect(left, top, right - left, bottom - top);  // return the selection bounds
 }
 
-void TileAtlas::HandlePanning(sf::Vector2f mousePos, bool isPanning, float deltaTime) {
-    static sf::Vector2f lastMousePos;
+void TileAtlas::HandlePanning(sf::Vector2i mousePos, bool isPanning, float deltaTime) {
+    // mouse positions are in window pixels so the pan distance doesn't change as the view moves under the cursor
+    static sf::Vector2i lastMousePos;
+    static bool wasPanning = false;
     if (isPanning) {
-        if (lastMousePos != sf::Vector2f(0, 0)) {
-            sf::Vector2f delta = lastMousePos - mousePos;
-            editor.GetAtlasView().move(delta);
-            editor.atlasViewOffset += delta;
+        if (wasPanning) {
+            editor.PanView(editor.GetAtlasView(), lastMousePos, mousePos);
         }
         lastMousePos = mousePos;
+        wasPanning = true;
     }
     else {
-        lastMousePos = sf::Vector2f(0, 0);
+        wasPanning = false;
     }
-}
-
-void TileAtlas::UpdateTileSize(float scaleFactor) {
-    // calculate new tile size for zooming using the base tile size and scale factor
-    atlasTileSize = static_cast<int>(editor.baseTileSize * scaleFactor);
 }
\ No newline at end of file
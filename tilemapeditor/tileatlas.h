@@ -10,10 +10,11 @@
 struct TileAtlas {
     Editor& editor;
     float deltaTime;  // delta time for consistent timing
-    float atlasTileSize = 16.0f;     // base tile size (e.g. 16x16)
     sf::Texture textureAtlas; // atlas texture
+    std::string atlasPath = "assets/map/tilemap16.png";   // image the atlas texture is loaded from, also written into saved maps
     sf::Sprite atlasSprite; // atlas sprite
     sf::Vector2f atlasPos = { 0, 0 }; // default atlas position
+    int atlasColumns = 1;   // number of tile columns in the atlas texture, used to convert between atlas indices and texture rects
 
     bool isSelecting = false;
     sf::Vector2i selectionStartIndices; // drag-selection start
@@ -31,12 +32,12 @@ struct TileAtlas {
     bool Initialize();
     void HandleSelection(sf::Vector2f mousePos, bool isDragging, float deltaTime);
     sf::IntRect GetSelectionBounds() const;
-    void HandlePanning(sf::Vector2f mousePos, bool isPanning, float deltaTime);
-    void UpdateTileSize(float scaleFactor);
-    void DrawAtlas(sf::RenderTarget& target);
-    void DrawDragSelection(sf::RenderTarget& target);
+    void HandlePanning(sf::Vector2i mousePos, bool isPanning, float deltaTime);
+    void AddToFrame(RenderFrame& frame);    // the visible part of the atlas, its grid and the drag selection
     // getter functions to return information about the tile e.g. texture of a tile, and a tile at specific atlas index
     const sf::Texture& GetTexture() { return textureAtlas; }
+    sf::IntRect GetTileRect(int index) const;
+    int GetTileIndex(const sf::IntRect& rect) const;
     const SelectedTile GetSelectedTile() const { return selectedTile; }
     void SetSelectedTile(const SelectedTile& tile) { selectedTile = tile; }
 };
@@ -0,0 +1,34 @@
+#ifndef TILECELL_H
+#define TILECELL_H
+
+#include <cstdint>
+
+// a layer cell packs the atlas tile id and its orientation flags into 32 bits so a layer can be stored as a flat array
+// the id is the atlas index + 1 so that a zeroed cell is an empty tile
+typedef std::uint32_t TileCell;
+
+enum TileCellFlags : std::uint32_t {
+    FlipHorizontal = 0x80000000u,  // mirror the tile along its vertical axis
+    FlipVertical = 0x40000000u,    // mirror the tile along its horizontal axis
+    FlipDiagonal = 0x20000000u,    // swap the tile's x and y axes (combined with the flips this gives the 90 degree rotations)
+    TileFlagMask = 0xE0000000u,
+    TileIdMask = 0x1FFFFFFFu
+};
+
+const TileCell EmptyCell = 0;
+
+// build a cell from an atlas index (-1 or any negative index gives an empty cell)
+inline TileCell MakeTileCell(int atlasIndex, std::uint32_t flags = 0) {
+    if (atlasIndex < 0) return EmptyCell;
+    return (static_cast<TileCell>(atlasIndex + 1) & TileIdMask) | (flags & TileFlagMask);
+}
+
+// atlas index stored in a cell, -1 for an empty cell
+inline int GetCellAtlasIndex(TileCell cell) {
+    return static_cast<int>(cell & TileIdMask) - 1;
+}
+
+inline std::uint32_t GetCellFlags(TileCell cell) {
+    return cell & TileFlagMask;
+}
+#endif
\ No newline at end of file
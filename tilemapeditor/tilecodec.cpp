@@ -0,0 +1,282 @@
+#include "tilecodec.h"
+#include "threadpool.h"
+#include <algorithm>
+
+static void EncodeNone(const TileCell* cells, size_t count, ByteWriter& out) {
+    out.WriteCells(cells, count);
+}
+
+static bool DecodeNone(const char* data, size_t size, TileCell* cells, size_t count) {
+    if (size != count * sizeof(TileCell)) return false;
+    ByteReader in(data, size);
+    return in.ReadCells(cells, count);
+}
+
+static void EncodeRunLength(const TileCell* cells, size_t count, ByteWriter& out) {
+    size_t i = 0;
+    while (i < count) {
+        TileCell cell = cells[i];
+        size_t start = i;
+        while (i < count && cells[i] == cell) { ++i; }
+        out.WriteU32(static_cast<std::uint32_t>(i - start));
+        out.WriteU32(cell);
+    }
+}
+
+static bool DecodeRunLength(const char* data, size_t size, TileCell* cells, size_t count) {
+    if (size % 8 != 0) return false;
+    ByteReader in(data, size);
+    size_t filled = 0;
+    for (size_t run = 0; run < size / 8; ++run) {
+        std::uint32_t length = in.ReadU32();
+        TileCell cell = in.ReadU32();
+        if (length > count - filled) return false;  // a run may never write past the end of the chunk
+        std::fill(cells + filled, cells + filled + length, cell);
+        filled += length;
+    }
+    return filled == count && !in.HasFailed();
+}
+
+// differences are zigzag encoded so small negative steps stay small varints
+static std::uint32_t ZigZag(std::uint32_t delta) { return (delta << 1) ^ (0u - (delta >> 31)); }
+static std::uint32_t UnZigZag(std::uint32_t value) { return (value >> 1) ^ (0u - (value & 1)); }
+
+static void EncodeDeltaRunLength(const TileCell* cells, size_t count, ByteWriter& out) {
+    TileCell previous = EmptyCell;
+    size_t i = 0;
+    while (i < count) {
+        std::uint32_t delta = cells[i] - previous;
+        size_t start = i;
+        previous = cells[i++];
+        while (i < count && cells[i] - previous == delta) { previous = cells[i++]; }
+        out.WriteVarint(static_cast<std::uint32_t>(i - start));
+        out.WriteVarint(ZigZag(delta));
+    }
+}
+
+static bool DecodeDeltaRunLength(const char* data, size_t size, TileCell* cells, size_t count) {
+    ByteReader in(data, size);
+    TileCell previous = EmptyCell;
+    size_t filled = 0;
+    while (in.GetRemaining() > 0) {
+        std::uint32_t length = in.ReadVarint();
+        std::uint32_t delta = UnZigZag(in.ReadVarint());
+        if (in.HasFailed() || length > count - filled) return false;
+        for (std::uint32_t i = 0; i < length; ++i) {
+            previous += delta;
+            cells[filled++] = previous;
+        }
+    }
+    return filled == count;
+}
+
+/*  lz payload = sequences of: token byte (literal count in the high nibble, match length - 4 in the low nibble),
+    extra literal count bytes, the literals, u16 match offset, extra match length bytes
+    a nibble of 15 continues in extra bytes that are added up until one is below 255
+    the last sequence only holds literals and ends the payload right after them
+*/
+const size_t LzMinMatch = 4;
+const size_t LzMaxOffset = 0xFFFF;
+const int LzHashBits = 12;
+
+static std::uint32_t Load32(const unsigned char* bytes) {
+    std::uint32_t value;
+    std::memcpy(&value, bytes, 4);
+    return value;
+}
+
+static void WriteLzLength(ByteWriter& out, size_t length) {
+    for (; length >= 255; length -= 255) { out.WriteU8(255); }
+    out.WriteU8(static_cast<std::uint8_t>(length));
+}
+
+static void WriteLzSequence(ByteWriter& out, const unsigned char* literals, size_t literalCount, size_t offset, size_t matchLength) {
+    size_t matchCode = matchLength ? matchLength - LzMinMatch : 0;
+    out.WriteU8(static_cast<std::uint8_t>((std::min<size_t>(literalCount, 15) << 4) | std::min<size_t>(matchCode, 15)));
+    if (literalCount >= 15) WriteLzLength(out, literalCount - 15);
+    out.WriteBytes(literals, literalCount);
+    if (!matchLength) return;   // the final sequence has no match
+    out.WriteU16(static_cast<std::uint16_t>(offset));
+    if (matchCode >= 15) WriteLzLength(out, matchCode - 15);
+}
+
+static void EncodeLz(const TileCell* cells, size_t count, ByteWriter& out) {
+    // compress the little-endian byte image so the payload doesn't depend on the host
+    std::vector<char> image;
+    ByteWriter imageWriter(image);
+    imageWriter.WriteCells(cells, count);
+    const unsigned char* bytes = reinterpret_cast<const unsigned char*>(image.data());
+    size_t size = image.size();
+    std::vector<std::uint32_t> table(size_t(1) << LzHashBits, 0);  // last position + 1 of each hashed 4 byte sequence
+    size_t anchor = 0;
+    size_t position = 0;
+    while (position + LzMinMatch <= size) {
+        std::uint32_t sequence = Load32(bytes + position);
+        std::uint32_t& slot = table[(sequence * 2654435761u) >> (32 - LzHashBits)];
+        size_t candidate = slot;
+        slot = static_cast<std::uint32_t>(position + 1);
+        if (candidate == 0 || position - (candidate - 1) > LzMaxOffset || Load32(bytes + candidate - 1) != sequence) {
+            ++position;
+            continue;
+        }
+        size_t match = candidate - 1;
+        size_t length = LzMinMatch;
+        while (position + length < size && bytes[match + length] == bytes[position + length]) { ++length; }
+        WriteLzSequence(out, bytes + anchor, position - anchor, position - match, length);
+        position += length;
+        anchor = position;
+    }
+    WriteLzSequence(out, bytes + anchor, size - anchor, 0, 0);
+}
+
+static bool ReadLzLength(ByteReader& in, size_t& length) {
+    std::uint8_t byte;
+    do {
+        byte = in.ReadU8();
+        length += byte;
+    } while (byte == 255 && !in.HasFailed());
+    return !in.HasFailed();
+}
+
+static bool DecodeLz(const char* data, size_t size, TileCell* cells, size_t count) {
+    // decode into the little-endian byte image, in place when that is also the host layout
+    size_t outputSize = count * sizeof(TileCell);
+    std::vector<char> image;
+    unsigned char* output;
+    if (IsLittleEndianHost()) {
+        output = reinterpret_cast<unsigned char*>(cells);
+    }
+    else {
+        image.resize(outputSize);
+        output = reinterpret_cast<unsigned char*>(image.data());
+    }
+    ByteReader in(data, size);
+    size_t produced = 0;
+    for (;;) {
+        std::uint8_t token = in.ReadU8();
+        size_t literalCount = token >> 4;
+        if (literalCount == 15 && !ReadLzLength(in, literalCount)) return false;
+        if (literalCount > outputSize - produced || !in.ReadBytes(output + produced, literalCount)) return false;
+        produced += literalCount;
+        if (in.GetRemaining() == 0) break;  // the final sequence ends right after its literals
+        size_t offset = in.ReadU16();
+        size_t length = (token & 15) + LzMinMatch;
+        if ((token & 15) == 15 && !ReadLzLength(in, length)) return false;
+        if (in.HasFailed() || offset == 0 || offset > produced || length > outputSize - produced) return false;
+        // byte by byte on purpose, a match may overlap the bytes it is producing
+        for (size_t i = 0; i < length; ++i, ++produced) { output[produced] = output[produced - offset]; }
+    }
+    if (produced != outputSize || in.HasFailed()) return false;
+    if (!image.empty()) {
+        ByteReader cellReader(image.data(), image.size());
+        return cellReader.ReadCells(cells, count);
+    }
+    return true;
+}
+
+const std::vector<TileCodec>& GetTileCodecs() {
+    static const std::vector<TileCodec> codecs = {
+        { LayerCodec::None, "none", true, EncodeNone, DecodeNone },
+        { LayerCodec::RunLength, "rle", true, EncodeRunLength, DecodeRunLength },
+        { LayerCodec::DeltaRunLength, "delta-rle", true, EncodeDeltaRunLength, DecodeDeltaRunLength },
+        { LayerCodec::Lz, "lz", false, EncodeLz, DecodeLz }
+    };
+    return codecs;
+}
+
+const TileCodec* GetTileCodec(LayerCodec id) {
+    for (const auto& codec : GetTileCodecs()) {
+        if (codec.id == id) return &codec;
+    }
+    return nullptr;
+}
+
+const TileCodec* FindTileCodec(const std::string& name) {
+    for (const auto& codec : GetTileCodecs()) {
+        if (name == codec.name) return &codec;
+    }
+    return nullptr;
+}
+
+LayerCodec ChooseLayerCodec(CodecPreference preference, const std::vector<const TileCell*>& chunks, size_t count) {
+    if (preference == CodecPreference::Fastest || chunks.empty() || count == 0) return LayerCodec::None;
+    std::vector<const TileCodec*> candidates;
+    for (const auto& codec : GetTileCodecs()) {
+        if (codec.id != LayerCodec::None && (preference == CodecPreference::Smallest || codec.isCheap)) candidates.push_back(&codec);
+    }
+    // the candidates only encode a sample of windows spread evenly over the layer, so choosing costs the same for any layer size
+    // and the chosen codec is the only one that encodes everything, a json layer comes in as a single chunk and is split into windows too
+    const size_t windowCells = std::min<size_t>(count, 4096);
+    const size_t sampleCells = 1 << 16;
+    size_t windowsPerChunk = count / windowCells;
+    size_t windowCount = chunks.size() * windowsPerChunk;
+    size_t sampleCount = std::min(windowCount, std::max<size_t>(sampleCells / windowCells, 1));
+    std::vector<size_t> sizes(sampleCount * candidates.size());
+    ThreadPool::GetShared().ParallelFor("choose codec", sampleCount, [&](size_t s) {
+        size_t window = s * windowCount / sampleCount;
+        const TileCell* cells = chunks[window / windowsPerChunk] + (window % windowsPerChunk) * windowCells;
+        std::vector<char> scratch;
+        for (size_t k = 0; k < candidates.size(); ++k) {
+            scratch.clear();
+            ByteWriter out(scratch);
+            candidates[k]->encode(cells, windowCells, out);
+            sizes[s * candidates.size() + k] = scratch.size();
+        }
+    });
+    LayerCodec best = LayerCodec::None;
+    size_t bestSize = sampleCount * windowCells * sizeof(TileCell);
+    for (size_t k = 0; k < candidates.size(); ++k) {
+        size_t total = 0;
+        for (size_t s = 0; s < sampleCount; ++s) { total += sizes[s * candidates.size() + k]; }
+        if (total < bestSize) {
+            best = candidates[k]->id;
+            bestSize = total;
+        }
+    }
+    return best;
+}
+
+static const char Base64Alphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+std::string EncodeBase64(const char* data, size_t size) {
+    const unsigned char* bytes = reinterpret_cast<const unsigned char*>(data);
+    std::string text;
+    text.reserve((size + 2) / 3 * 4);
+    for (size_t i = 0; i < size; i += 3) {
+        std::uint32_t group = static_cast<std::uint32_t>(bytes[i]) << 16;
+        if (i + 1 < size) group |= static_cast<std::uint32_t>(bytes[i + 1]) << 8;
+        if (i + 2 < size) group |= bytes[i + 2];
+        text.push_back(Base64Alphabet[(group >> 18) & 63]);
+        text.push_back(Base64Alphabet[(group >> 12) & 63]);
+        text.push_back(i + 1 < size ? Base64Alphabet[(group >> 6) & 63] : '=');
+        text.push_back(i + 2 < size ? Base64Alphabet[group & 63] : '=');
+    }
+    return text;
+}
+
+bool DecodeBase64(const std::string& text, std::vector<char>& out) {
+    out.clear();
+    out.reserve(text.size() / 4 * 3);
+    std::uint32_t group = 0;
+    int bits = 0;
+    size_t padding = 0;
+    for (char c : text) {
+        int value;
+        if (c >= 'A' && c <= 'Z') value = c - 'A';
+        else if (c >= 'a' && c <= 'z') value = c - 'a' + 26;
+        else if (c >= '0' && c <= '9') value = c - '0' + 52;
+        else if (c == '+') value = 62;
+        else if (c == '/') value = 63;
+        else if (c == '=') { ++padding; continue; }
+        else if (c == '\n' || c == '\r' || c == ' ') continue;
+        else return false;
+        if (padding > 0) return false;  // data after padding
+        group = (group << 6) | static_cast<std::uint32_t>(value);
+        bits += 6;
+        if (bits >= 8) {
+            bits -= 8;
+            out.push_back(static_cast<char>((group >> bits) & 0xFF));
+        }
+    }
+    return padding <= 2;
+}
\ No newline at end of file
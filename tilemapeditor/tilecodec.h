@@ -0,0 +1,41 @@
+#ifndef TILECODEC_H
+#define TILECODEC_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "tilecell.h"
+#include "mapformat.h"
+
+// codec ids are stored in saved maps, so existing values must never change
+enum class LayerCodec : std::uint8_t {
+    None = 0,           // cells stored as a packed u32 array, loaded with a single copy (or used in place from a mapped file)
+    RunLength = 1,      // (u32 run length, u32 cell) pairs, for long runs of the same tile
+    DeltaRunLength = 2, // runs of equal differences between neighbouring cells as varints, also catches rows of consecutive tile ids
+    Lz = 3              // lz77 over the cell bytes with 16 bit offsets, picks up repeated patterns the run based codecs miss
+};
+
+// how a codec is picked for each layer when saving
+enum class CodecPreference {
+    Fastest,    // no compression, binary maps stay mappable in place
+    Balanced,   // the smallest of the run based codecs, which decode about as fast as a copy
+    Smallest    // the smallest of every codec
+};
+
+struct TileCodec {
+    LayerCodec id;
+    const char* name;   // used for the "codec" field of json maps
+    bool isCheap;       // encodes and decodes in a single linear pass, considered by CodecPreference::Balanced
+    void (*encode)(const TileCell* cells, size_t count, ByteWriter& out);  // appends one payload
+    bool (*decode)(const char* data, size_t size, TileCell* cells, size_t count);  // fills exactly count cells, false on malformed data
+};
+
+const std::vector<TileCodec>& GetTileCodecs();
+const TileCodec* GetTileCodec(LayerCodec id);
+const TileCodec* FindTileCodec(const std::string& name);
+// picks the codec for a layer from a sample of its chunks, every chunk holds count cells
+LayerCodec ChooseLayerCodec(CodecPreference preference, const std::vector<const TileCell*>& chunks, size_t count);
+
+std::string EncodeBase64(const char* data, size_t size);
+bool DecodeBase64(const std::string& text, std::vector<char>& out);
+#endif
\ No newline at end of file
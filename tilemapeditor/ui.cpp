@@ -1,4 +1,6 @@
 #include "ui.h"
+#include "threadpool.h"
+#include "asyncio.h"
 #include <iostream>
 
 UI::UI(Editor& editor) : editor(editor) {}
@@ -9,10 +11,55 @@ bool UI::Initialize() {
         std::cerr << "Failed to load font: \n";
         return false;
     }
+    // status line for saves and loads, e.g. the progress of a background save
+    statusText.setFont(font);
+    statusText.setCharacterSize(20);
+    statusText.setFillColor(sf::Color::White);
+    statusText.setPosition(240.f, 20.f);
+    // progress of long edits on the line below
+    taskText = statusText;
+    taskText.setPosition(240.f, 50.f);
+    // the buttons are laid out here, measuring text loads glyphs into the font, which only the render thread may do once it runs
+    // define the properties of the UI buttons
+    sf::Vector2f buttonSize(200.f, 100.f); // button dimensions
+    float buttonSpacing = 20.f;          // spacing between buttons
+    float startX = 20.f;                 // starting x position of buttons
+    float startY = 20.f;                 // starting y position of buttons
+    // define the buttons labels with dimensions since each button will create a new layer of that size
+    std::vector<std::string> buttonLabels = {
+        "50x50 Grid",
+        "100x100 Grid",
+        "200x200 Grid",
+        "Infinite Grid",
+        "Merge Layers",
+        "Save Tilemap",
+        "Load Tilemap"
+    };
+    // iterate through the button labels vector and create buttons
+    for (size_t i = 0; i < buttonLabels.size(); ++i) {
+        // create and position the buttons with the properties defined above
+        Button button;
+        button.shape.setSize(buttonSize);
+        button.shape.setFillColor(sf::Color(150, 150, 150));
+        button.shape.setPosition(startX, startY + i * (buttonSize.y + buttonSpacing));
+        // set the properties of the button label
+        button.label.setFont(font);
+        button.label.setString(buttonLabels[i]);
+        button.label.setCharacterSize(24);
+        button.label.setFillColor(sf::Color::Black);
+        // center the label on the button
+        sf::FloatRect textBounds = button.label.getLocalBounds();
+        button.label.setPosition(
+            button.shape.getPosition().x + (buttonSize.x - textBounds.width) / 2.f - textBounds.left,
+            button.shape.getPosition().y + (buttonSize.y - textBounds.height) / 2.f - textBounds.top
+        );
+        // store the button in the ui buttons vector
+        buttons.push_back(button);
+    }
     return true;
 }
 
-void UI::HandleInteraction(const sf::Vector2f& mousePos, sf::RenderWindow& window) {
+void UI::HandleInteraction(const sf::Vector2f& mousePos) {
     for (const auto& button : buttons) {
         // check each buttons bounds to see if it contains the mouse position passed in from handle events
         if (button.shape.getGlobalBounds().contains(mousePos)) {
@@ -33,64 +80,48 @@ void UI::HandleInteraction(const sf::Vector2f& mousePos, sf::RenderWindow& windo
             else if (label == "200x200 Grid") {
                 editor.GetTileMap()->AddLayer(200, 200);
             }
+            else if (label == "Infinite Grid") {
+                editor.GetTileMap()->AddLayer(0, 0, true);  // an infinite layer starts empty and grows as tiles are painted
+            }
             else if (label == "Merge Layers") {
-                editor.GetTileMap()->showMergedLayers = !editor.GetTileMap()->showMergedLayers; // toggle showMergedLayers bool to true or false everytime button is pressed
-                editor.GetTileMap()->MergeAllLayers(window, editor.GetTileMap()->showMergedLayers); // merge layers depending on the current bool state
+                editor.GetTileMap()->showMergedLayers = !editor.GetTileMap()->showMergedLayers; // toggle showMergedLayers bool to true or false everytime button is pressed, the next frame shows or hides the merged layers
             }
+            editor.RequestRedraw();
             std::cout << "Button clicked: " << label << "\n";
             break; // exit once the click was handled
         }
     }
 }
 
-void UI::DrawUI(sf::RenderWindow& window) {
-    // populate the buttons vector if empty 
-    if (buttons.empty()) {
-        // define the properties of the UI buttons
-        sf::Vector2f buttonSize(200.f, 100.f); // button dimensions
-        float buttonSpacing = 20.f;          // spacing between buttons
-        float startX = 20.f;                 // starting x position of buttons
-        float startY = 20.f;                 // starting y position of buttons
-        // define the buttons labels with dimensions since each button will create a new layer of that size
-        std::vector<std::string> buttonLabels = {
-            "50x50 Grid",
-            "100x100 Grid",
-            "200x200 Grid",
-            "Merge Layers",
-            "Save Tilemap",
-            "Load Tilemap"
-        };
-        // iterate through the button labels vector and create buttons
-        for (size_t i = 0; i < buttonLabels.size(); ++i) {
-            // create and position the buttons with the properties defined above
-            Button button;
-            button.shape.setSize(buttonSize);
-            button.shape.setFillColor(sf::Color(150, 150, 150));
-            button.shape.setPosition(startX, startY + i * (buttonSize.y + buttonSpacing));
-            // set the properties of the button label
-            button.label.setFont(font);
-            button.label.setString(buttonLabels[i]);
-            button.label.setCharacterSize(24);
-            button.label.setFillColor(sf::Color::Black);
-            // center the label on the button
-            sf::FloatRect textBounds = button.label.getLocalBounds();
-            button.label.setPosition(
-                button.shape.getPosition().x + (buttonSize.x - textBounds.width) / 2.f - textBounds.left,
-                button.shape.getPosition().y + (buttonSize.y - textBounds.height) / 2.f - textBounds.top
-            );
-            // store the button in the ui buttons vector
-            buttons.push_back(button);
-        }
-    }
+void UI::AddToFrame(RenderFrame& frame) {
+    // the frame gets copies, the render thread lays out their text while the ui goes on changing its own
     for (const auto& button : buttons) {
-        // draw the button and its label
-        window.draw(button.shape);
-        window.draw(button.label);
+        frame.uiItems.push_back(std::make_shared<sf::RectangleShape>(button.shape));
+        frame.uiItems.push_back(std::make_shared<sf::Text>(button.label));
+    }
+    std::string status = editor.GetTileMap()->GetStatus();
+    if (!status.empty()) {
+        std::shared_ptr<sf::Text> text = std::make_shared<sf::Text>(statusText);
+        text->setString(status);
+        frame.uiItems.push_back(text);
+    }
+    std::string tasks = editor.GetScheduler().GetStatus();
+    if (!tasks.empty()) {
+        std::shared_ptr<sf::Text> text = std::make_shared<sf::Text>(taskText);
+        text->setString(tasks + " (Esc to stop)");
+        frame.uiItems.push_back(text);
+    }
+    if (isTextInputActive) {
+        std::shared_ptr<sf::Text> text = std::make_shared<sf::Text>(inputTextDisplay);
+        text->setString(inputText);
+        frame.uiItems.push_back(std::make_shared<sf::RectangleShape>(inputBox));
+        frame.uiItems.push_back(text);
     }
 }
 
 void UI::ActivateTextInput() {
     isTextInputActive = true;
+    editor.RequestRedraw();
     inputText.clear();
     // set up input box
     inputBox.setSize(sf::Vector2f(300.f, 50.f));
@@ -105,6 +136,7 @@ void UI::ActivateTextInput() {
 
 void UI::HandleTextInput(const sf::Event& event) {
     if (isTextInputActive) {
+        if (event.type == sf::Event::TextEntered || event.type == sf::Event::KeyPressed) { editor.RequestRedraw(); }   // the input box changes or closes
         if (event.type == sf::Event::TextEntered) {
             // handle text input (except special characters like backspace)
             if (event.text.unicode == '\b' && !inputText.empty()) {
@@ -121,10 +153,10 @@ void UI::HandleTextInput(const sf::Event& event) {
                 std::cout << "Filename entered: " << inputText << "\n";
                 // call save or load function
                 if (lastClickedButton == "Save Tilemap") {
-                    editor.GetTileMap()->SaveTileMap(inputText);
+                    editor.GetTileMap()->SaveTileMapAsync(inputText);  // written in the background, the status line shows its progress
                 }
                 else if (lastClickedButton == "Load Tilemap") {
-                    editor.GetTileMap()->LoadTileMap(inputText);
+                    editor.GetTileMap()->LoadTileMapAsync(inputText);  // layers show up as they are read
                 }
             }
             else if (event.key.code == sf::Keyboard::Escape) {
@@ -134,12 +166,15 @@ void UI::HandleTextInput(const sf::Event& event) {
             }
         }
     }
-}
-
-void UI::DrawTextInput(sf::RenderWindow& window) {
-    if (isTextInputActive) {
-        inputTextDisplay.setString(inputText);
-        window.draw(inputBox);
-        window.draw(inputTextDisplay);
+    else if (event.type == sf::Event::KeyPressed && event.key.code == sf::Keyboard::Escape && editor.GetTileMap()->IsLoading()) {
+        editor.GetTileMap()->CancelLoad();  // escape outside of the input box cancels a load and keeps the current map
     }
-}
\ No newline at end of file
+    else if (event.type == sf::Event::KeyPressed && event.key.code == sf::Keyboard::Escape && editor.GetScheduler().IsBusy()) {
+        editor.GetScheduler().CancelNewest();   // then it stops the long edit started last, whatever it already changed stays
+        editor.RequestRedraw();
+    }
+    else if (event.type == sf::Event::KeyPressed && event.key.code == sf::Keyboard::F3) {
+        ThreadPool::GetShared().PrintStats(std::cout);  // time spent per kind of background task and how busy the workers are
+        AsyncIO::GetShared().PrintStats(std::cout);     // how much of a save went to the disk
+    }
+}
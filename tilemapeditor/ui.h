@@ -26,13 +26,14 @@ private:
     sf::RectangleShape inputBox;    // rectangle element for the input box
     sf::Text inputTextDisplay;  // text to display the input to the screen
     std::string lastClickedButton;  // string to store which button was pressed (between save or load tilemap buttons)
+    sf::Text statusText;    // progress and outcome of saves and loads
+    sf::Text taskText;      // progress of the long edits the frame scheduler is running
 public:
     UI(Editor& editor);
     bool Initialize();
-    void HandleInteraction(const sf::Vector2f& mousePos, sf::RenderWindow& window);
+    void HandleInteraction(const sf::Vector2f& mousePos);
     void ActivateTextInput();
     void HandleTextInput(const sf::Event& event);
-    void DrawTextInput(sf::RenderWindow& window);
-    void DrawUI(sf::RenderWindow& window);
+    void AddToFrame(RenderFrame& frame);    // the buttons, the status line and the input box
 };
 #endif
\ No newline at end of file